@@ -0,0 +1,284 @@
+#include "async.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define ASYNC_COMPLETION_GROUP 64
+
+typedef struct {
+    AsyncExecutor *executor;
+    int handle;
+    AsyncRequest *head; // Waiting requests, oldest first
+    AsyncRequest *tail;
+    bool scheduled;     // A pool task is draining this queue
+} FileQueue;
+
+struct AsyncExecutor {
+    FileSystem *fs;
+    ThreadPool *pool;
+    FileQueue **queues; // Indexed by file handle, created on first use
+    int queue_capacity;
+    int pending;        // Submitted but not yet completed
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+};
+
+AsyncExecutor *async_executor_create(FileSystem *fs, int thread_count)
+{
+    AsyncExecutor *executor = (AsyncExecutor *)calloc(1, sizeof(AsyncExecutor));
+    if (!executor)
+        return NULL;
+    executor->pool = thread_pool_create(thread_count);
+    if (!executor->pool)
+    {
+        free(executor);
+        return NULL;
+    }
+    executor->fs = fs;
+    pthread_mutex_init(&executor->lock, NULL);
+    pthread_cond_init(&executor->completed, NULL);
+    return executor;
+}
+
+void async_executor_destroy(AsyncExecutor *executor)
+{
+    if (!executor)
+        return;
+    async_drain(executor);
+    thread_pool_destroy(executor->pool);
+    for (int i = 0; i < executor->queue_capacity; i++)
+        free(executor->queues[i]);
+    free(executor->queues);
+    pthread_mutex_destroy(&executor->lock);
+    pthread_cond_destroy(&executor->completed);
+    free(executor);
+}
+
+// Callbacks run before any request in the group is marked done, so a waiter
+// never sees a request finished while its callback could still be using it.
+// The group is completed under one lock acquisition and one wakeup.
+static void complete_requests(AsyncExecutor *executor, AsyncRequest *first, AsyncRequest *end)
+{
+    int count = 0;
+    for (AsyncRequest *r = first; r != end; r = r->next, count++)
+    {
+        if (r->callback)
+            r->callback(r, r->ctx);
+    }
+    pthread_mutex_lock(&executor->lock);
+    // A completed request may be freed by its owner, so read links first.
+    for (AsyncRequest *r = first; r != end;)
+    {
+        AsyncRequest *next = r->next;
+        r->done = true;
+        r = next;
+    }
+    executor->pending -= count;
+    pthread_cond_broadcast(&executor->completed);
+    pthread_mutex_unlock(&executor->lock);
+}
+
+static void run_inserts(FileSystem *fs, int handle, AsyncRequest *first, int count)
+{
+    Record *records = (Record *)malloc(count * sizeof(Record));
+    if (!records)
+    {
+        for (AsyncRequest *r = first; count-- > 0; r = r->next)
+            r->status = insert_record_by_handle(fs, handle, r->record);
+        return;
+    }
+    int i = 0;
+    for (AsyncRequest *r = first; i < count; r = r->next)
+        records[i++] = r->record;
+
+    // Inserts are stored in order until the file fills, so the first
+    // `stored` requests succeeded and the rest did not.
+    int stored = insert_records_by_handle(fs, handle, records, count);
+    i = 0;
+    for (AsyncRequest *r = first; i < count; r = r->next, i++)
+        r->status = i < stored ? 0 : -1;
+    free(records);
+}
+
+static void run_searches(FileSystem *fs, int handle, AsyncRequest *first, int count)
+{
+    int *ids = (int *)malloc(3 * count * sizeof(int));
+    if (!ids)
+    {
+        for (AsyncRequest *r = first; count-- > 0; r = r->next)
+            r->status = search_record_by_handle(fs, handle, r->id, &r->block_num, &r->offset);
+        return;
+    }
+    int *block_nums = ids + count;
+    int *offsets = block_nums + count;
+    int i = 0;
+    for (AsyncRequest *r = first; i < count; r = r->next)
+        ids[i++] = r->id;
+
+    // On failure (the file is gone) the output arrays are left unwritten.
+    bool failed = search_records_by_handle(fs, handle, ids, count, block_nums, offsets) < 0;
+    i = 0;
+    for (AsyncRequest *r = first; i < count; r = r->next, i++)
+    {
+        r->block_num = failed ? -1 : block_nums[i];
+        r->offset = failed ? -1 : offsets[i];
+        r->status = r->block_num != -1 ? 0 : -1;
+    }
+    free(ids);
+}
+
+// Executes requests in submission order, merging each run of consecutive
+// inserts, or of consecutive lookups, into one batched call. Finished runs are
+// completed in groups of ASYNC_COMPLETION_GROUP requests: taking the executor
+// lock once per run made the worker and submitters hand it back and forth.
+static void run_batch(AsyncExecutor *executor, int handle, AsyncRequest *batch)
+{
+    FileSystem *fs = executor->fs;
+    AsyncRequest *finished = batch;
+    int finished_count = 0;
+    while (batch)
+    {
+        AsyncRequest *end = batch->next;
+        int count = 1;
+        if (batch->type == ASYNC_INSERT || batch->type == ASYNC_SEARCH)
+        {
+            while (end && end->type == batch->type)
+            {
+                end = end->next;
+                count++;
+            }
+        }
+
+        switch (batch->type)
+        {
+        case ASYNC_INSERT:
+            run_inserts(fs, handle, batch, count);
+            break;
+        case ASYNC_SEARCH:
+            run_searches(fs, handle, batch, count);
+            break;
+        case ASYNC_DELETE_LOGICAL:
+            batch->status = delete_record_logical_by_handle(fs, handle, batch->id);
+            break;
+        case ASYNC_DELETE_PHYSICAL:
+            batch->status = delete_record_physical_by_handle(fs, handle, batch->id);
+            break;
+        }
+
+        finished_count += count;
+        batch = end;
+        if (finished_count >= ASYNC_COMPLETION_GROUP || !batch)
+        {
+            complete_requests(executor, finished, batch);
+            finished = batch;
+            finished_count = 0;
+        }
+    }
+}
+
+// Pool task: drains one file's queue until it stays empty. Only one task per
+// queue runs at a time, which serialises all work on that file.
+static void drain_queue(void *arg)
+{
+    FileQueue *queue = (FileQueue *)arg;
+    AsyncExecutor *executor = queue->executor;
+    for (;;)
+    {
+        pthread_mutex_lock(&executor->lock);
+        AsyncRequest *batch = queue->head;
+        queue->head = NULL;
+        queue->tail = NULL;
+        if (!batch)
+            queue->scheduled = false;
+        pthread_mutex_unlock(&executor->lock);
+        if (!batch)
+            return;
+        run_batch(executor, queue->handle, batch);
+    }
+}
+
+// Caller holds executor->lock.
+static FileQueue *queue_for(AsyncExecutor *executor, int handle)
+{
+    if (handle >= executor->queue_capacity)
+    {
+        int new_capacity = executor->queue_capacity > 0 ? executor->queue_capacity : INITIAL_FILE_SLOTS;
+        while (new_capacity <= handle)
+            new_capacity *= 2;
+        FileQueue **grown = (FileQueue **)realloc(executor->queues, new_capacity * sizeof(FileQueue *));
+        if (!grown)
+            return NULL;
+        for (int i = executor->queue_capacity; i < new_capacity; i++)
+            grown[i] = NULL;
+        executor->queues = grown;
+        executor->queue_capacity = new_capacity;
+    }
+    if (!executor->queues[handle])
+    {
+        FileQueue *queue = (FileQueue *)calloc(1, sizeof(FileQueue));
+        if (!queue)
+            return NULL;
+        queue->executor = executor;
+        queue->handle = handle;
+        executor->queues[handle] = queue;
+    }
+    return executor->queues[handle];
+}
+
+int async_submit(AsyncExecutor *executor, AsyncRequest *request)
+{
+    FileSystem *fs = executor->fs;
+    request->status = -1;
+    request->block_num = -1;
+    request->offset = -1;
+    request->done = false;
+    request->next = NULL;
+
+    pthread_mutex_lock(&executor->lock);
+    executor->pending++;
+    bool live = request->handle >= 0 && request->handle < fs->slot_count && fs->file_metadata[request->handle].in_use;
+    FileQueue *queue = live ? queue_for(executor, request->handle) : NULL;
+    if (!queue)
+    {
+        pthread_mutex_unlock(&executor->lock);
+        complete_requests(executor, request, NULL);
+        return -1;
+    }
+    if (queue->tail)
+        queue->tail->next = request;
+    else
+        queue->head = request;
+    queue->tail = request;
+    bool schedule = !queue->scheduled;
+    queue->scheduled = true;
+    pthread_mutex_unlock(&executor->lock);
+
+    // Run on the caller's thread rather than strand the queue.
+    if (schedule && thread_pool_submit(executor->pool, drain_queue, queue) != 0)
+        drain_queue(queue);
+    return 0;
+}
+
+bool async_done(AsyncExecutor *executor, AsyncRequest *request)
+{
+    pthread_mutex_lock(&executor->lock);
+    bool done = request->done;
+    pthread_mutex_unlock(&executor->lock);
+    return done;
+}
+
+int async_wait(AsyncExecutor *executor, AsyncRequest *request)
+{
+    pthread_mutex_lock(&executor->lock);
+    while (!request->done)
+        pthread_cond_wait(&executor->completed, &executor->lock);
+    pthread_mutex_unlock(&executor->lock);
+    return request->status;
+}
+
+void async_drain(AsyncExecutor *executor)
+{
+    pthread_mutex_lock(&executor->lock);
+    while (executor->pending > 0)
+        pthread_cond_wait(&executor->completed, &executor->lock);
+    pthread_mutex_unlock(&executor->lock);
+}
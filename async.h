@@ -0,0 +1,55 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "file_system.h"
+
+typedef enum {
+    ASYNC_INSERT,
+    ASYNC_SEARCH,
+    ASYNC_DELETE_LOGICAL,
+    ASYNC_DELETE_PHYSICAL
+} AsyncOpType;
+
+typedef struct AsyncRequest AsyncRequest;
+// Runs on an executor thread once the request's results are set, before it
+// is marked done; it must not free the request if anyone waits on it.
+typedef void (*AsyncCallback)(AsyncRequest *request, void *ctx);
+
+// One submitted operation, which doubles as its future. The caller owns the
+// storage and keeps it alive until the request is done.
+struct AsyncRequest {
+    AsyncOpType type;
+    int handle;
+    Record record;          // ASYNC_INSERT
+    int id;                 // Other operations
+    AsyncCallback callback; // Optional
+    void *ctx;
+    int status;             // 0 or -1, as from the synchronous *_by_handle calls
+    int block_num;          // Where ASYNC_SEARCH found the record
+    int offset;
+    // Executor state
+    bool done;
+    AsyncRequest *next;
+};
+
+typedef struct AsyncExecutor AsyncExecutor;
+
+// Requests queue per file and each file's queue is drained by one worker at a
+// time, so operations on a file run in submission order while different files
+// proceed in parallel. Queued runs of inserts go into the file in one block
+// pass and queued runs of lookups are resolved together. File-level calls
+// (create, delete, rename, snapshot, defragment, compact, clear) must not run
+// while requests are in flight; call async_drain first.
+AsyncExecutor *async_executor_create(FileSystem *fs, int thread_count);
+// Drains outstanding requests, then stops the workers.
+void async_executor_destroy(AsyncExecutor *executor);
+// Returns 0 once queued, or -1 if the handle is not a live file, in which case
+// the request completes immediately with status -1.
+int async_submit(AsyncExecutor *executor, AsyncRequest *request);
+bool async_done(AsyncExecutor *executor, AsyncRequest *request);
+// Blocks until the request completes and returns its status.
+int async_wait(AsyncExecutor *executor, AsyncRequest *request);
+// Blocks until every submitted request has completed.
+void async_drain(AsyncExecutor *executor);
+
+#endif // ASYNC_H
@@ -0,0 +1,475 @@
+// Benchmarks for the file system simulator.
+//
+//   ./benchmark [total_blocks] [block_size] [scan_passes]
+//       Full-file scans and compaction under each page mode and NUMA policy.
+//       Prints the layout each configuration actually obtained, so runs on
+//       hosts without huge pages or NUMA show the fallbacks.
+//   ./benchmark workload [seed]
+//       Runs the seeded regression workloads and prints their statistics.
+//   ./benchmark baseline <file>
+//       Records the regression workloads' throughput in <file>.
+//   ./benchmark regress <file> [max_drop_percent]
+//       Re-runs them and exits non-zero if any is slower than the baseline by
+//       more than max_drop_percent.
+//   ./benchmark replay <trace>
+//       Replays a trace recorded from a session and reports its throughput.
+//   ./benchmark async [requests]
+//       Issues the same request stream synchronously and through the async
+//       executor with 1, 2, 4 and 8 threads.
+
+#include "async.h"
+#include "file_system.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FILES 16 // Files created; every other one is deleted to fragment memory
+#define WORKLOAD_BLOCKS 4096
+#define WORKLOAD_BLOCK_SIZE 16
+#define WORKLOAD_OPERATIONS 500000
+#define WORKLOAD_SEED 2024
+#define WORKLOAD_RUNS 5 // Best of this many runs is compared, to damp noise
+#define REGRESSION_TOLERANCE_PERCENT 10.0
+#define ASYNC_REQUESTS 400000
+
+typedef struct {
+    const char *name;
+    KeyDistribution distribution;
+    int churn_percent; // Taken from the delete share
+} WorkloadScenario;
+
+static const WorkloadScenario scenarios[] = {
+    {"uniform", DIST_UNIFORM, 0},
+    {"zipfian", DIST_ZIPFIAN, 0},
+    {"sequential", DIST_SEQUENTIAL, 0},
+    {"zipfian-churn", DIST_ZIPFIAN, 1},
+};
+#define SCENARIO_COUNT (int)(sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct {
+    bool ok;
+    StorageOptions obtained;
+    double setup_ms;
+    double scan_ms;
+    double records_per_ms;
+    double compact_ms;
+    double rescan_ms;
+} BenchResult;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static bool sum_ids(const Record *record, void *ctx)
+{
+    *(long long *)ctx += record->id;
+    return true;
+}
+
+// Scans every live file `passes` times; returns milliseconds per pass.
+static double time_scans(FileSystem *fs, int passes, long long *records)
+{
+    long long checksum = 0;
+    *records = 0;
+    double start = now_ms();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int handle = 0; handle < fs->slot_count; handle++)
+        {
+            int visited = scan_file(fs, handle, sum_ids, &checksum);
+            if (visited > 0 && pass == 0)
+                *records += visited;
+        }
+    }
+    double elapsed = (now_ms() - start) / passes;
+    if (checksum == 42) // Keeps the scans from being optimised away
+        printf(" ");
+    return elapsed;
+}
+
+// Fills each file to capacity from one generated CSV stream.
+static int fill_files(FileSystem *fs, int records_per_file)
+{
+    FILE *csv = tmpfile();
+    if (!csv)
+        return -1;
+    fprintf(csv, "id,data\n");
+    for (int i = 0; i < records_per_file; i++)
+        fprintf(csv, "%d,Benchmark Data %d\n", i + 1, i + 1);
+
+    for (int handle = 0; handle < fs->slot_count; handle++)
+    {
+        TransferResult result;
+        rewind(csv);
+        if (import_records(fs, handle, csv, FORMAT_CSV, &result) != 0)
+        {
+            fclose(csv);
+            return -1;
+        }
+    }
+    fclose(csv);
+    return 0;
+}
+
+// The library reports maintenance steps on stdout, so results are gathered
+// first and tabulated once every configuration has run.
+static BenchResult run_configuration(int total_blocks, int block_size, int passes, StorageOptions options)
+{
+    BenchResult result = {false, options, 0, 0, 0, 0, 0};
+    double start = now_ms();
+    FileSystem *fs = init_filesystem_ex(total_blocks, block_size, &options);
+    if (!fs)
+        return result;
+    fs->compaction_prompt = false;
+
+    int blocks_per_file = (total_blocks - 1) / BENCH_FILES;
+    for (int i = 0; i < BENCH_FILES; i++)
+    {
+        char name[MAX_FILENAME];
+        snprintf(name, sizeof(name), "bench%d", i);
+        create_file(fs, name, blocks_per_file * block_size, false, false);
+    }
+    fill_files(fs, blocks_per_file * block_size);
+
+    result.setup_ms = now_ms() - start;
+    long long records;
+    result.scan_ms = time_scans(fs, passes, &records);
+    result.records_per_ms = records / result.scan_ms;
+
+    for (int i = 0; i < BENCH_FILES; i += 2)
+        delete_file_by_handle(fs, i);
+    start = now_ms();
+    compact_memory_parallel(fs);
+    result.compact_ms = now_ms() - start;
+    result.rescan_ms = time_scans(fs, passes, &records);
+
+    result.obtained = fs->storage;
+    result.ok = true;
+    free_filesystem(fs);
+    return result;
+}
+
+// Best throughput of WORKLOAD_RUNS runs on fresh volumes; -1 on failure.
+static double run_scenario(const WorkloadScenario *scenario, unsigned int seed, WorkloadStats *stats)
+{
+    double best = -1;
+    for (int run = 0; run < WORKLOAD_RUNS; run++)
+    {
+        FileSystem *fs = init_filesystem(WORKLOAD_BLOCKS, WORKLOAD_BLOCK_SIZE);
+        if (!fs)
+            return -1;
+        WorkloadConfig config;
+        default_workload_config(fs, &config, scenario->distribution, seed);
+        config.delete_percent -= scenario->churn_percent;
+        config.operations = WORKLOAD_OPERATIONS;
+        WorkloadStats run_stats;
+        int status = run_workload(fs, &config, &run_stats);
+        free_filesystem(fs);
+        if (status != 0)
+            return -1;
+        if (run_stats.ops_per_second > best)
+        {
+            best = run_stats.ops_per_second;
+            *stats = run_stats;
+        }
+    }
+    return best;
+}
+
+static int workload_mode(unsigned int seed)
+{
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+    {
+        WorkloadStats stats;
+        printf("\n== %s (seed %u) ==\n", scenarios[i].name, seed);
+        if (run_scenario(&scenarios[i], seed, &stats) < 0)
+        {
+            printf("Workload failed.\n");
+            return 1;
+        }
+        display_workload_stats(&stats);
+    }
+    return 0;
+}
+
+static int baseline_mode(const char *path)
+{
+    double throughput[SCENARIO_COUNT];
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+    {
+        WorkloadStats stats;
+        throughput[i] = run_scenario(&scenarios[i], WORKLOAD_SEED, &stats);
+        if (throughput[i] < 0)
+        {
+            printf("Workload %s failed.\n", scenarios[i].name);
+            return 1;
+        }
+    }
+
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        printf("Could not open %s.\n", path);
+        return 1;
+    }
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+    {
+        fprintf(out, "%s %.0f\n", scenarios[i].name, throughput[i]);
+        printf("%-14s %12.0f ops/s\n", scenarios[i].name, throughput[i]);
+    }
+    if (fclose(out) != 0)
+    {
+        printf("Could not write %s.\n", path);
+        return 1;
+    }
+    printf("Baseline written to %s.\n", path);
+    return 0;
+}
+
+static int regress_mode(const char *path, double max_drop_percent)
+{
+    FILE *in = fopen(path, "r");
+    if (!in)
+    {
+        printf("Could not open baseline %s.\n", path);
+        return 1;
+    }
+    double baseline[SCENARIO_COUNT];
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+        baseline[i] = -1;
+    char name[64];
+    double ops;
+    while (fscanf(in, "%63s %lf", name, &ops) == 2)
+    {
+        for (int i = 0; i < SCENARIO_COUNT; i++)
+        {
+            if (strcmp(name, scenarios[i].name) == 0)
+                baseline[i] = ops;
+        }
+    }
+    fclose(in);
+
+    int failures = 0;
+    printf("%-14s %12s %12s %8s\n", "Workload", "Baseline", "Now", "Change");
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+    {
+        WorkloadStats stats;
+        double now = run_scenario(&scenarios[i], WORKLOAD_SEED, &stats);
+        if (baseline[i] <= 0 || now < 0)
+        {
+            printf("%-14s %s\n", scenarios[i].name, baseline[i] <= 0 ? "missing from baseline" : "failed");
+            failures++;
+            continue;
+        }
+        double change = (now - baseline[i]) / baseline[i] * 100.0;
+        bool regressed = -change > max_drop_percent;
+        printf("%-14s %12.0f %12.0f %+7.1f%%%s\n", scenarios[i].name, baseline[i], now, change, regressed ? "  REGRESSION" : "");
+        if (regressed)
+            failures++;
+    }
+    if (failures)
+        printf("FAIL: %d workload(s) failed, missing or slower than baseline by over %.1f%%.\n", failures, max_drop_percent);
+    else
+        printf("PASS (tolerance %.1f%%).\n", max_drop_percent);
+    return failures ? 1 : 0;
+}
+
+static int replay_mode(const char *path)
+{
+    // Replay onto a volume shaped like the one the trace was recorded on; the
+    // header's placement policy is applied when its line is replayed.
+    int total_blocks = WORKLOAD_BLOCKS;
+    int block_size = WORKLOAD_BLOCK_SIZE;
+    FILE *in = fopen(path, "r");
+    if (!in)
+    {
+        printf("Could not open %s.\n", path);
+        return 1;
+    }
+    if (read_trace_header(in, &total_blocks, &block_size) != 0)
+    {
+        total_blocks = WORKLOAD_BLOCKS;
+        block_size = WORKLOAD_BLOCK_SIZE;
+        printf("%s has no volume header; replaying onto %d blocks of %d records.\n", path, total_blocks, block_size);
+    }
+    fclose(in);
+
+    FileSystem *fs = init_filesystem(total_blocks, block_size);
+    if (!fs)
+        return 1;
+    WorkloadStats stats;
+    int status = replay_trace_file(fs, path, &stats);
+    if (status == 0)
+        display_workload_stats(&stats);
+    else
+        printf("Could not replay %s.\n", path);
+    free_filesystem(fs);
+    return status == 0 ? 0 : 1;
+}
+
+// A volume of WORKLOAD_FILES half-full files, sized like the workloads'.
+static FileSystem *async_volume(int *handles, WorkloadConfig *config)
+{
+    FileSystem *fs = init_filesystem(WORKLOAD_BLOCKS, WORKLOAD_BLOCK_SIZE);
+    if (!fs)
+        return NULL;
+    default_workload_config(fs, config, DIST_ZIPFIAN, WORKLOAD_SEED);
+    for (int f = 0; f < WORKLOAD_FILES; f++)
+    {
+        char filename[MAX_FILENAME];
+        snprintf(filename, sizeof(filename), "async%d", f);
+        handles[f] = create_file(fs, filename, config->file_records, false, false);
+        Record record = {0, "Async Data", false};
+        for (int id = 1; id <= config->file_records / 2; id++)
+        {
+            record.id = id;
+            insert_record_by_handle(fs, handles[f], record);
+        }
+    }
+    return fs;
+}
+
+// 80% lookups and 20% inserts, spread over the files, from a fixed seed.
+static void fill_requests(AsyncRequest *requests, int count, const int *handles, int key_space)
+{
+    unsigned int state = WORKLOAD_SEED;
+    for (int i = 0; i < count; i++)
+    {
+        state = state * 1103515245 + 12345;
+        unsigned int roll = state >> 8;
+        AsyncRequest *request = &requests[i];
+        memset(request, 0, sizeof(*request));
+        request->handle = handles[roll % WORKLOAD_FILES];
+        request->id = 1 + (int)((roll / WORKLOAD_FILES) % key_space);
+        request->type = roll % 5 == 0 ? ASYNC_INSERT : ASYNC_SEARCH;
+        request->record.id = request->id;
+        snprintf(request->record.data, sizeof(request->record.data), "Async Data %d", request->id);
+    }
+}
+
+static int async_mode(int count)
+{
+    AsyncRequest *requests = (AsyncRequest *)malloc(count * sizeof(AsyncRequest));
+    if (!requests)
+        return 1;
+    int handles[WORKLOAD_FILES];
+    WorkloadConfig config;
+
+    FileSystem *fs = async_volume(handles, &config);
+    if (!fs)
+    {
+        free(requests);
+        return 1;
+    }
+    fill_requests(requests, count, handles, config.key_space);
+    double start = now_ms();
+    for (int i = 0; i < count; i++)
+    {
+        AsyncRequest *request = &requests[i];
+        if (request->type == ASYNC_INSERT)
+            request->status = insert_record_by_handle(fs, request->handle, request->record);
+        else
+            request->status = search_record_by_handle(fs, request->handle, request->id, &request->block_num, &request->offset);
+    }
+    double sync_ms = now_ms() - start;
+    free_filesystem(fs);
+
+    double async_ms[4];
+    int thread_counts[4] = {1, 2, 4, 8};
+    for (int t = 0; t < 4; t++)
+    {
+        fs = async_volume(handles, &config);
+        AsyncExecutor *executor = fs ? async_executor_create(fs, thread_counts[t]) : NULL;
+        if (!executor)
+        {
+            free_filesystem(fs);
+            free(requests);
+            return 1;
+        }
+        fill_requests(requests, count, handles, config.key_space);
+        start = now_ms();
+        for (int i = 0; i < count; i++)
+            async_submit(executor, &requests[i]);
+        async_drain(executor);
+        async_ms[t] = now_ms() - start;
+        async_executor_destroy(executor);
+        free_filesystem(fs);
+    }
+
+    printf("\n%d requests (80%% lookups, 20%% inserts) over %d files, %ld CPUs online\n", count, WORKLOAD_FILES,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-18s %10s %12s\n", "Mode", "ms", "ops/s");
+    printf("%-18s %10.1f %12.0f\n", "synchronous", sync_ms, count / sync_ms * 1000.0);
+    for (int t = 0; t < 4; t++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "async, %d thread%s", thread_counts[t], thread_counts[t] > 1 ? "s" : "");
+        printf("%-18s %10.1f %12.0f\n", label, async_ms[t], count / async_ms[t] * 1000.0);
+    }
+    free(requests);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "workload") == 0)
+        return workload_mode(argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : WORKLOAD_SEED);
+    if (argc > 2 && strcmp(argv[1], "baseline") == 0)
+        return baseline_mode(argv[2]);
+    if (argc > 2 && strcmp(argv[1], "regress") == 0)
+        return regress_mode(argv[2], argc > 3 ? atof(argv[3]) : REGRESSION_TOLERANCE_PERCENT);
+    if (argc > 2 && strcmp(argv[1], "replay") == 0)
+        return replay_mode(argv[2]);
+    if (argc > 1 && strcmp(argv[1], "async") == 0)
+        return async_mode(argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : ASYNC_REQUESTS);
+
+    int total_blocks = argc > 1 ? atoi(argv[1]) : 16384;
+    int block_size = argc > 2 ? atoi(argv[2]) : 64;
+    int passes = argc > 3 ? atoi(argv[3]) : 5;
+    if (total_blocks <= BENCH_FILES || block_size <= 0 || passes <= 0)
+    {
+        printf("Usage: %s [total_blocks > %d] [block_size] [scan_passes]\n", argv[0], BENCH_FILES);
+        return 1;
+    }
+
+    StorageOptions configurations[] = {
+        {PAGES_DEFAULT, NUMA_DEFAULT, -1},
+        {PAGES_TRANSPARENT, NUMA_DEFAULT, -1},
+        {PAGES_EXPLICIT, NUMA_DEFAULT, -1},
+        {PAGES_DEFAULT, NUMA_INTERLEAVE, -1},
+        {PAGES_TRANSPARENT, NUMA_INTERLEAVE, -1},
+        {PAGES_TRANSPARENT, NUMA_BIND, 0},
+    };
+
+    int count = (int)(sizeof(configurations) / sizeof(configurations[0]));
+    BenchResult results[sizeof(configurations) / sizeof(configurations[0])];
+    for (int i = 0; i < count; i++)
+        results[i] = run_configuration(total_blocks, block_size, passes, configurations[i]);
+
+    printf("\n%d blocks x %d records, %d scan passes\n", total_blocks, block_size, passes);
+    printf("%-24s %-12s %-24s %-12s %9s %9s %9s %10s %9s\n",
+           "Pages requested", "NUMA", "Pages obtained", "NUMA", "Setup ms", "Scan ms", "Mrec/s", "Compact ms", "Rescan ms");
+    for (int i = 0; i < count; i++)
+    {
+        printf("%-24s %-12s ", page_mode_name(configurations[i].page_mode), numa_policy_name(configurations[i].numa_policy));
+        if (!results[i].ok)
+        {
+            printf("init failed\n");
+            continue;
+        }
+        printf("%-24s %-12s %9.1f %9.2f %9.1f %10.2f %9.2f\n",
+               page_mode_name(results[i].obtained.page_mode),
+               numa_policy_name(results[i].obtained.numa_policy),
+               results[i].setup_ms,
+               results[i].scan_ms,
+               results[i].records_per_ms / 1000.0,
+               results[i].compact_ms,
+               results[i].rescan_ms);
+    }
+    return 0;
+}
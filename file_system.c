@@ -2,547 +2,3466 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// mbind(2) modes, from <numaif.h>, which needs libnuma headers.
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#define MPOL_INTERLEAVE 3
+#endif
+
+// FNV-1a
+static unsigned int hash_filename(const char *filename)
+{
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Doubles the bucket array and rehashes every live file.
+static int grow_name_index(FileSystem *fs)
+{
+    int new_count = fs->bucket_count * 2;
+    int *buckets = (int *)malloc(new_count * sizeof(int));
+    if (!buckets)
+        return -1;
+    for (int i = 0; i < new_count; i++)
+        buckets[i] = -1;
+
+    for (int i = 0; i < fs->slot_count; i++)
+    {
+        Metadata *meta = &fs->file_metadata[i];
+        if (!meta->in_use)
+            continue;
+        unsigned int bucket = hash_filename(meta->filename) % new_count;
+        meta->next_in_bucket = buckets[bucket];
+        buckets[bucket] = i;
+    }
+
+    free(fs->name_buckets);
+    fs->name_buckets = buckets;
+    fs->bucket_count = new_count;
+    return 0;
+}
+
+static void index_file_name(FileSystem *fs, int handle)
+{
+    // Keep the load factor at or below one. Rehashing already links this
+    // (live) handle in; on allocation failure chains just get longer.
+    if (fs->file_count > fs->bucket_count && grow_name_index(fs) == 0)
+        return;
+
+    Metadata *meta = &fs->file_metadata[handle];
+    unsigned int bucket = hash_filename(meta->filename) % fs->bucket_count;
+    meta->next_in_bucket = fs->name_buckets[bucket];
+    fs->name_buckets[bucket] = handle;
+}
+
+static void unindex_file_name(FileSystem *fs, int handle)
+{
+    unsigned int bucket = hash_filename(fs->file_metadata[handle].filename) % fs->bucket_count;
+    int *link = &fs->name_buckets[bucket];
+    while (*link != -1)
+    {
+        if (*link == handle)
+        {
+            *link = fs->file_metadata[handle].next_in_bucket;
+            return;
+        }
+        link = &fs->file_metadata[*link].next_in_bucket;
+    }
+}
+
+// Returns the metadata of a live file, or NULL for a stale or out-of-range handle.
+static Metadata *file_from_handle(FileSystem *fs, int handle)
+{
+    if (handle < 0 || handle >= fs->slot_count || !fs->file_metadata[handle].in_use)
+        return NULL;
+    return &fs->file_metadata[handle];
+}
+
+// Takes a slot from the free list, or a fresh one (growing the table if full).
+static int acquire_file_slot(FileSystem *fs)
+{
+    int handle;
+    if (fs->free_slot != -1)
+    {
+        handle = fs->free_slot;
+        fs->free_slot = fs->file_metadata[handle].next_free_slot;
+    }
+    else
+    {
+        if (fs->slot_count == fs->slot_capacity)
+        {
+            int new_capacity = fs->slot_capacity * 2;
+            Metadata *grown = (Metadata *)realloc(fs->file_metadata, new_capacity * sizeof(Metadata));
+            if (!grown)
+                return -1;
+            fs->file_metadata = grown;
+            fs->slot_capacity = new_capacity;
+        }
+        handle = fs->slot_count++;
+    }
+    fs->file_metadata[handle].in_use = true;
+    fs->file_metadata[handle].next_free_slot = -1;
+    fs->file_count++;
+    return handle;
+}
+
+static void release_file_slot(FileSystem *fs, int handle)
+{
+    fs->file_metadata[handle].in_use = false;
+    fs->file_metadata[handle].next_free_slot = fs->free_slot;
+    fs->free_slot = handle;
+    fs->file_count--;
+}
+
+// Next block of a file after current_block, or -1 at the end of the file.
+// *position is the index of current_block within the file and is advanced;
+// snapshots need it because their blocks are listed rather than chained.
+static int next_file_block(FileSystem *fs, Metadata *meta, int current_block, int *position)
+{
+    (*position)++;
+    if (meta->is_snapshot)
+        return *position < meta->block_count ? meta->block_list[*position] : -1;
+    if (meta->is_contiguous)
+    {
+        current_block++;
+        return current_block < meta->first_block + meta->block_count ? current_block : -1;
+    }
+    return fs->blocks[current_block].next_block;
+}
+
+// splitmix64 finalizer; spreads sequential ids across the whole word.
+static uint64_t hash_id(int id)
+{
+    uint64_t x = (uint64_t)(uint32_t)id + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Per-block filter probes: the file filter's double hashing, over the block's
+// own fs->block_filter_words words. Computed once per id, then tested against
+// every block it may be in.
+typedef struct {
+    int word[BLOOM_HASHES];
+    uint64_t bit[BLOOM_HASHES];
+} BlockProbe;
+
+static void block_filter_probe(FileSystem *fs, uint64_t hash, BlockProbe *probe)
+{
+    uint32_t bits = (uint32_t)fs->block_filter_words * 64;
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++)
+    {
+        uint32_t bit = (h1 + i * h2) % bits;
+        probe->word[i] = bit / 64;
+        probe->bit[i] = 1ULL << (bit % 64);
+    }
+}
+
+static void block_filter_add(Block *block, const BlockProbe *probe)
+{
+    for (int i = 0; i < BLOOM_HASHES; i++)
+        block->id_filter[probe->word[i]] |= probe->bit[i];
+}
+
+// False means no record in the block has the probed id.
+static bool block_may_contain(const Block *block, const BlockProbe *probe)
+{
+    for (int i = 0; i < BLOOM_HASHES; i++)
+    {
+        if (!(block->id_filter[probe->word[i]] & probe->bit[i]))
+            return false;
+    }
+    return true;
+}
+
+// Per-file Bloom filter probes, derived by double hashing.
+static void bloom_add(Metadata *meta, uint64_t hash)
+{
+    if (!meta->bloom)
+        return;
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++)
+    {
+        uint32_t bit = (h1 + i * h2) % meta->bloom_bits;
+        meta->bloom[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+// False means the id is definitely not in the file. A missing filter
+// (allocation failed) can rule nothing out.
+static bool bloom_may_contain(Metadata *meta, uint64_t hash)
+{
+    if (!meta->bloom)
+        return true;
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++)
+    {
+        uint32_t bit = (h1 + i * h2) % meta->bloom_bits;
+        if (!(meta->bloom[bit / 64] & (1ULL << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+// Sizes the file filter for a full file: BLOOM_BITS_PER_RECORD bits per slot.
+static void allocate_bloom(FileSystem *fs, Metadata *meta)
+{
+    long long bits = (long long)meta->block_count * fs->block_size * BLOOM_BITS_PER_RECORD;
+    int words = (int)((bits + 63) / 64);
+    if (words < 1)
+        words = 1;
+    meta->bloom = (uint64_t *)calloc(words, sizeof(uint64_t));
+    meta->bloom_bits = meta->bloom ? words * 64 : 0;
+}
+
+static int compare_index_entries(const DataIndexEntry *x, const DataIndexEntry *y)
+{
+    int order = strncmp(x->data, y->data, sizeof(x->data));
+    if (order != 0)
+        return order;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static void make_index_entry(DataIndexEntry *entry, const char *data, int id)
+{
+    strncpy(entry->data, data, sizeof(entry->data) - 1);
+    entry->data[sizeof(entry->data) - 1] = '\0';
+    entry->id = id;
+}
+
+static void free_data_index(DataIndex *index)
+{
+    if (!index)
+        return;
+    free(index->nodes);
+    free(index);
+}
+
+static void reset_data_index(DataIndex *index)
+{
+    index->root = -1;
+    index->count = 0;
+    index->used = 0;
+    index->free_node = -1;
+    index->complete = true;
+}
+
+static int node_height(const DataIndex *index, int node)
+{
+    return node == -1 ? 0 : index->nodes[node].height;
+}
+
+static void update_height(DataIndex *index, int node)
+{
+    int left = node_height(index, index->nodes[node].left);
+    int right = node_height(index, index->nodes[node].right);
+    index->nodes[node].height = 1 + (left > right ? left : right);
+}
+
+static int rotate_right(DataIndex *index, int node)
+{
+    int pivot = index->nodes[node].left;
+    index->nodes[node].left = index->nodes[pivot].right;
+    index->nodes[pivot].right = node;
+    update_height(index, node);
+    update_height(index, pivot);
+    return pivot;
+}
+
+static int rotate_left(DataIndex *index, int node)
+{
+    int pivot = index->nodes[node].right;
+    index->nodes[node].right = index->nodes[pivot].left;
+    index->nodes[pivot].left = node;
+    update_height(index, node);
+    update_height(index, pivot);
+    return pivot;
+}
+
+// Restores the AVL invariant at `node` after one of its subtrees changed
+// height by one; returns the subtree's new root.
+static int rebalance(DataIndex *index, int node)
+{
+    update_height(index, node);
+    DataIndexNode *n = &index->nodes[node];
+    int balance = node_height(index, n->left) - node_height(index, n->right);
+    if (balance > 1)
+    {
+        int left = n->left;
+        if (node_height(index, index->nodes[left].left) < node_height(index, index->nodes[left].right))
+            index->nodes[node].left = rotate_left(index, left);
+        return rotate_right(index, node);
+    }
+    if (balance < -1)
+    {
+        int right = n->right;
+        if (node_height(index, index->nodes[right].right) < node_height(index, index->nodes[right].left))
+            index->nodes[node].right = rotate_right(index, right);
+        return rotate_left(index, node);
+    }
+    return node;
+}
+
+// Equal keys (a file may repeat an id with the same data) go right.
+static int tree_insert(DataIndex *index, int node, int added)
+{
+    if (node == -1)
+        return added;
+    if (compare_index_entries(&index->nodes[added].entry, &index->nodes[node].entry) < 0)
+        index->nodes[node].left = tree_insert(index, index->nodes[node].left, added);
+    else
+        index->nodes[node].right = tree_insert(index, index->nodes[node].right, added);
+    return rebalance(index, node);
+}
+
+// Unlinks the smallest node of a subtree into *removed; returns the new root.
+static int tree_remove_min(DataIndex *index, int node, int *removed)
+{
+    if (index->nodes[node].left == -1)
+    {
+        *removed = node;
+        return index->nodes[node].right;
+    }
+    index->nodes[node].left = tree_remove_min(index, index->nodes[node].left, removed);
+    return rebalance(index, node);
+}
+
+// Unlinks one node equal to key into *removed (left -1 if none matches).
+static int tree_remove(DataIndex *index, int node, const DataIndexEntry *key, int *removed)
+{
+    if (node == -1)
+        return -1;
+    DataIndexNode *n = &index->nodes[node];
+    int order = compare_index_entries(key, &n->entry);
+    if (order < 0)
+        n->left = tree_remove(index, n->left, key, removed);
+    else if (order > 0)
+        n->right = tree_remove(index, n->right, key, removed);
+    else
+    {
+        *removed = node;
+        if (n->left == -1 || n->right == -1)
+            return n->left != -1 ? n->left : n->right;
+        // Two children: the in-order successor takes this node's place.
+        int successor;
+        int right = tree_remove_min(index, n->right, &successor);
+        index->nodes[successor].left = index->nodes[node].left;
+        index->nodes[successor].right = right;
+        return rebalance(index, successor);
+    }
+    return rebalance(index, node);
+}
+
+static void data_index_add(Metadata *meta, const Record *record)
+{
+    DataIndex *index = meta->data_index;
+    if (!index || !index->complete || record->is_deleted)
+        return;
+    int node = index->free_node;
+    if (node != -1)
+    {
+        index->free_node = index->nodes[node].left;
+    }
+    else
+    {
+        if (index->used == index->capacity)
+        {
+            int new_capacity = index->capacity > 0 ? index->capacity * 2 : 64;
+            DataIndexNode *grown = (DataIndexNode *)realloc(index->nodes, new_capacity * sizeof(DataIndexNode));
+            if (!grown)
+            {
+                index->complete = false;
+                return;
+            }
+            index->nodes = grown;
+            index->capacity = new_capacity;
+        }
+        node = index->used++;
+    }
+    DataIndexNode *n = &index->nodes[node];
+    make_index_entry(&n->entry, record->data, record->id);
+    n->left = -1;
+    n->right = -1;
+    n->height = 1;
+    index->root = tree_insert(index, index->root, node);
+    index->count++;
+}
+
+static void data_index_remove(Metadata *meta, const Record *record)
+{
+    DataIndex *index = meta->data_index;
+    if (!index || !index->complete)
+        return;
+    DataIndexEntry key;
+    make_index_entry(&key, record->data, record->id);
+    int removed = -1;
+    index->root = tree_remove(index, index->root, &key, &removed);
+    if (removed == -1)
+        return;
+    index->nodes[removed].left = index->free_node;
+    index->free_node = removed;
+    index->count--;
+}
+
+static void free_file_buffers(Metadata *meta)
+{
+    free(meta->block_list);
+    meta->block_list = NULL;
+    free(meta->bloom);
+    meta->bloom = NULL;
+    free_data_index(meta->data_index);
+    meta->data_index = NULL;
+}
+
+// Live files may be modified; snapshots are read-only.
+static Metadata *writable_file_from_handle(FileSystem *fs, int handle)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    return meta && !meta->is_snapshot ? meta : NULL;
+}
+
+// Escapes tab, newline, carriage return and backslash so each traced
+// operation stays on one tab-separated line.
+static void trace_string(FILE *trace, const char *text)
+{
+    for (; *text; text++)
+    {
+        switch (*text)
+        {
+        case '\t':
+            fputs("\\t", trace);
+            break;
+        case '\n':
+            fputs("\\n", trace);
+            break;
+        case '\r':
+            fputs("\\r", trace);
+            break;
+        case '\\':
+            fputs("\\\\", trace);
+            break;
+        default:
+            fputc(*text, trace);
+        }
+    }
+}
+
+// Appends one line to the session trace, if one is being recorded. fields[0]
+// is the operation code; each following 's' or 'd' consumes a string or int.
+static void trace_op(FileSystem *fs, const char *fields, ...)
+{
+    if (!fs->trace)
+        return;
+    va_list args;
+    va_start(args, fields);
+    flockfile(fs->trace); // Async executor threads may trace concurrently
+    fputc(fields[0], fs->trace);
+    for (const char *field = fields + 1; *field; field++)
+    {
+        fputc('\t', fs->trace);
+        if (*field == 'd')
+            fprintf(fs->trace, "%d", va_arg(args, int));
+        else
+            trace_string(fs->trace, va_arg(args, const char *));
+    }
+    fputc('\n', fs->trace);
+    funlockfile(fs->trace);
+    va_end(args);
+}
+
+// Lowest block that may be free: every block in [1, first_free) is allocated.
+// Releases lower the mark and searches raise it past allocated blocks, so
+// placement does not rescan the filled front of the volume on every create.
+static int lowest_free_block(FileSystem *fs)
+{
+    while (fs->first_free < fs->total_blocks && fs->allocation_table[fs->first_free])
+        fs->first_free++;
+    return fs->first_free;
+}
+
+// First free data block, or -1 if the volume is full.
+static int allocate_free_block(FileSystem *fs)
+{
+    int block = lowest_free_block(fs);
+    return block < fs->total_blocks ? block : -1;
+}
+
+// Block versions all come from one filesystem-wide clock, so a stamp is never
+// reused: a view cannot match a different block that later lands at its
+// block number, e.g. after compaction. Atomic because parallel maintenance
+// passes and async executor threads restamp blocks concurrently. Published
+// stamps are even; odd ones mark a write in progress.
+static uint64_t next_version(FileSystem *fs)
+{
+    return __atomic_add_fetch(&fs->version_clock, 2, __ATOMIC_RELAXED);
+}
+
+// Seqlock writer side. The odd stamp is visible before any record changes, and
+// the new even stamp only after all of them, so a reader that sees the same
+// even stamp before and after its reads knows they were not torn. Each block
+// has one writer at a time: its owning file's.
+static uint64_t begin_block_write(Block *block)
+{
+    uint64_t stamp = block->version;
+    __atomic_store_n(&block->version, stamp | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return stamp;
+}
+
+static void end_block_write(FileSystem *fs, Block *block)
+{
+    __atomic_store_n(&block->version, next_version(fs), __ATOMIC_RELEASE);
+}
+
+static uint64_t read_block_version(const Block *block)
+{
+    return __atomic_load_n(&block->version, __ATOMIC_ACQUIRE);
+}
+
+// Returns the block the live file `handle` should modify instead of block_num:
+// block_num itself when nothing else references it, otherwise a private copy
+// swapped into the file's chain (copy-on-write). Returns -1 if no block is
+// free for the copy.
+static int make_block_writable(FileSystem *fs, int handle, int block_num)
+{
+    if (fs->blocks[block_num].ref_count <= 1)
+        return block_num;
+
+    // The allocation table is the one structure writers of different files
+    // share; the async executor runs such writers concurrently.
+    pthread_mutex_lock(&fs->allocation_lock);
+    int copy = allocate_free_block(fs);
+    if (copy == -1)
+    {
+        pthread_mutex_unlock(&fs->allocation_lock);
+        return -1;
+    }
+    fs->allocation_table[copy] = true;
+    fs->free_blocks--;
+    pthread_mutex_unlock(&fs->allocation_lock);
+
+    Metadata *meta = &fs->file_metadata[handle];
+    // The copy cannot sit inside the contiguous run, so the file becomes linked.
+    if (meta->is_contiguous)
+    {
+        for (int i = 0; i < meta->block_count; i++)
+        {
+            fs->blocks[meta->first_block + i].next_block = i + 1 < meta->block_count ? meta->first_block + i + 1 : -1;
+        }
+        meta->is_contiguous = false;
+    }
+
+    Block *shared = &fs->blocks[block_num];
+    Block *target = &fs->blocks[copy];
+    memcpy(target->records, shared->records, shared->record_count * sizeof(Record));
+    target->record_count = shared->record_count;
+    memcpy(target->id_filter, shared->id_filter, fs->block_filter_words * sizeof(uint64_t));
+    target->next_block = shared->next_block;
+    target->owner = handle;
+    target->ref_count = 1;
+    end_block_write(fs, target);
+
+    if (meta->first_block == block_num)
+    {
+        meta->first_block = copy;
+    }
+    else
+    {
+        int prev = meta->first_block;
+        while (fs->blocks[prev].next_block != block_num)
+            prev = fs->blocks[prev].next_block;
+        fs->blocks[prev].next_block = copy;
+    }
+
+    // Only snapshots reference the original now.
+    shared->next_block = -1;
+    shared->owner = -1;
+    shared->ref_count--;
+    end_block_write(fs, shared);
+    return copy;
+}
+
+// Drops `handle`'s reference to a block, freeing it once nothing references it.
+static void release_block(FileSystem *fs, int block_num, int handle)
+{
+    Block *block = &fs->blocks[block_num];
+    if (block->owner == handle)
+    {
+        block->owner = -1;
+        block->next_block = -1;
+    }
+    if (--block->ref_count > 0)
+        return;
+    fs->allocation_table[block_num] = false;
+    fs->free_blocks++;
+    if (block_num < fs->first_free)
+        fs->first_free = block_num;
+    block->record_count = 0;
+    memset(block->id_filter, 0, fs->block_filter_words * sizeof(uint64_t));
+    end_block_write(fs, block);
+}
+
+const char *page_mode_name(PageMode mode)
+{
+    switch (mode)
+    {
+    case PAGES_TRANSPARENT:
+        return "transparent huge pages";
+    case PAGES_EXPLICIT:
+        return "explicit huge pages";
+    default:
+        return "default pages";
+    }
+}
+
+const char *numa_policy_name(NumaPolicy policy)
+{
+    switch (policy)
+    {
+    case NUMA_INTERLEAVE:
+        return "interleave";
+    case NUMA_BIND:
+        return "bind";
+    default:
+        return "first touch";
+    }
+}
+
+// Nodes listed in sysfs, as an mbind(2) node mask; 0 if none are visible.
+static unsigned long online_numa_nodes(void)
+{
+    unsigned long mask = 0;
+    char path[64];
+    for (int node = 0; node < MAX_NUMA_NODES; node++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+        if (access(path, F_OK) == 0)
+            mask |= 1UL << node;
+    }
+    return mask;
+}
+
+// Sets the arena's memory policy before any page is touched. Returns the
+// policy actually in effect: NUMA_DEFAULT when the kernel or sandbox refuses.
+static NumaPolicy apply_numa_policy(void *arena, size_t bytes, NumaPolicy policy, int node)
+{
+#ifdef SYS_mbind
+    if (policy == NUMA_DEFAULT)
+        return NUMA_DEFAULT;
+    unsigned long mask = online_numa_nodes();
+    if (policy == NUMA_BIND)
+        mask &= node >= 0 && node < MAX_NUMA_NODES ? 1UL << node : 0;
+    if (mask == 0)
+        return NUMA_DEFAULT;
+    int mode = policy == NUMA_BIND ? MPOL_BIND : MPOL_INTERLEAVE;
+    if (syscall(SYS_mbind, arena, bytes, mode, &mask, MAX_NUMA_NODES + 1, 0) == 0)
+        return policy;
+#else
+    (void)arena;
+    (void)bytes;
+    (void)policy;
+    (void)node;
+#endif
+    return NUMA_DEFAULT;
+}
+
+// Backs every block's records with slices of one anonymous mapping, so huge
+// pages and a NUMA policy can cover them. Each requested feature falls back on
+// its own; fs->storage records what was actually obtained. Returns -1 only if
+// no mapping at all could be made.
+static int map_record_arena(FileSystem *fs, const StorageOptions *options)
+{
+    PageMode mode = options->page_mode;
+    size_t bytes = (size_t)fs->total_blocks * fs->block_size * sizeof(Record);
+    if (mode != PAGES_DEFAULT)
+        bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+    void *arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (mode == PAGES_EXPLICIT)
+        arena = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (arena == MAP_FAILED)
+    {
+        // Usually no huge pages are reserved; transparent ones need no setup.
+        if (mode == PAGES_EXPLICIT)
+            mode = PAGES_TRANSPARENT;
+        arena = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED)
+            return -1;
+    }
+    if (mode == PAGES_TRANSPARENT)
+    {
+#ifdef MADV_HUGEPAGE
+        if (madvise(arena, bytes, MADV_HUGEPAGE) != 0)
+            mode = PAGES_DEFAULT;
+#else
+        mode = PAGES_DEFAULT;
+#endif
+    }
+
+    fs->record_arena = arena;
+    fs->arena_bytes = bytes;
+    fs->storage.page_mode = mode;
+    fs->storage.numa_policy = apply_numa_policy(arena, bytes, options->numa_policy, options->numa_node);
+    fs->storage.numa_node = fs->storage.numa_policy == NUMA_BIND ? options->numa_node : -1;
+    for (int i = 0; i < fs->total_blocks; i++)
+        fs->blocks[i].records = (Record *)arena + (size_t)i * fs->block_size;
+    return 0;
+}
+
+// One malloc per block: the original layout, used when no option asks for more.
+static int allocate_block_records(FileSystem *fs)
+{
+    for (int i = 0; i < fs->total_blocks; i++)
+    {
+        fs->blocks[i].records = (Record *)malloc(fs->block_size * sizeof(Record));
+        if (!fs->blocks[i].records)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                free(fs->blocks[j].records);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Releases every block's records and id filter.
+static void free_block_records(FileSystem *fs)
+{
+    free(fs->block_filters);
+    if (fs->record_arena)
+    {
+        munmap(fs->record_arena, fs->arena_bytes);
+        return;
+    }
+    for (int i = 0; i < fs->total_blocks; i++)
+    {
+        free(fs->blocks[i].records);
+    }
+}
 
 FileSystem *init_filesystem(int total_blocks, int block_size)
 {
-    FileSystem *fs = (FileSystem *)malloc(sizeof(FileSystem));
-    if (!fs)
-        return NULL;
+    return init_filesystem_ex(total_blocks, block_size, NULL);
+}
+
+FileSystem *init_filesystem_ex(int total_blocks, int block_size, const StorageOptions *options)
+{
+    FileSystem *fs = (FileSystem *)malloc(sizeof(FileSystem));
+    if (!fs)
+        return NULL;
+
+    fs->total_blocks = total_blocks;
+    fs->block_size = block_size;
+    fs->file_count = 0;
+
+    fs->allocation_table = (bool *)calloc(total_blocks, sizeof(bool));
+    if (!fs->allocation_table)
+    {
+        free(fs);
+        return NULL;
+    }
+    fs->allocation_table[0] = true; // Reserve first block for allocation table
+    fs->free_blocks = total_blocks > 1 ? total_blocks - 1 : 0;
+    fs->first_free = 1;
+
+    fs->blocks = (Block *)malloc(total_blocks * sizeof(Block));
+    if (!fs->blocks)
+    {
+        free(fs->allocation_table);
+        free(fs);
+        return NULL;
+    }
+
+    // Block filters get BLOOM_BITS_PER_RECORD bits per record slot, so they
+    // keep skipping blocks however many records a block holds.
+    long long filter_bits = (long long)block_size * BLOOM_BITS_PER_RECORD;
+    fs->block_filter_words = filter_bits > 64 ? (int)((filter_bits + 63) / 64) : 1;
+    fs->block_filters = (uint64_t *)calloc((size_t)total_blocks * fs->block_filter_words, sizeof(uint64_t));
+    if (!fs->block_filters)
+    {
+        free(fs->blocks);
+        free(fs->allocation_table);
+        free(fs);
+        return NULL;
+    }
+
+    fs->record_arena = NULL;
+    fs->arena_bytes = 0;
+    fs->storage = (StorageOptions){PAGES_DEFAULT, NUMA_DEFAULT, -1};
+    bool wants_arena = options && (options->page_mode != PAGES_DEFAULT || options->numa_policy != NUMA_DEFAULT);
+    if ((!wants_arena || map_record_arena(fs, options) != 0) && allocate_block_records(fs) != 0)
+    {
+        free(fs->block_filters);
+        free(fs->blocks);
+        free(fs->allocation_table);
+        free(fs);
+        return NULL;
+    }
+    for (int i = 0; i < total_blocks; i++)
+    {
+        fs->blocks[i].record_count = 0;
+        fs->blocks[i].next_block = -1;
+        fs->blocks[i].owner = -1;
+        fs->blocks[i].ref_count = 0;
+        fs->blocks[i].version = 0;
+        fs->blocks[i].id_filter = fs->block_filters + (size_t)i * fs->block_filter_words;
+    }
+    fs->version_clock = 0;
+
+    fs->slot_count = 0;
+    fs->slot_capacity = INITIAL_FILE_SLOTS;
+    fs->free_slot = -1;
+    fs->file_metadata = (Metadata *)malloc(fs->slot_capacity * sizeof(Metadata));
+    if (!fs->file_metadata)
+    {
+        free_block_records(fs);
+        free(fs->blocks);
+        free(fs->allocation_table);
+        free(fs);
+        return NULL;
+    }
+
+    fs->bucket_count = INITIAL_FILE_SLOTS;
+    fs->name_buckets = (int *)malloc(fs->bucket_count * sizeof(int));
+    if (!fs->name_buckets)
+    {
+        free_block_records(fs);
+        free(fs->blocks);
+        free(fs->allocation_table);
+        free(fs->file_metadata);
+        free(fs);
+        return NULL;
+    }
+    for (int i = 0; i < fs->bucket_count; i++)
+        fs->name_buckets[i] = -1;
+
+    fs->thread_count = 1;
+    fs->pool = NULL;
+    fs->placement_policy = PLACEMENT_FIRST_FIT;
+    fs->next_fit_cursor = 1;
+    fs->compaction_prompt = true;
+    fs->compactions_needed = 0;
+    fs->trace = NULL;
+    pthread_mutex_init(&fs->allocation_lock, NULL);
+
+    return fs;
+}
+
+// Frees everything without reporting; used by the churn simulation.
+static void release_filesystem(FileSystem *fs)
+{
+    thread_pool_destroy(fs->pool);
+    if (fs->trace)
+        fclose(fs->trace);
+    pthread_mutex_destroy(&fs->allocation_lock);
+    for (int i = 0; i < fs->slot_count; i++)
+    {
+        if (fs->file_metadata[i].in_use)
+            free_file_buffers(&fs->file_metadata[i]);
+    }
+    free_block_records(fs);
+    free(fs->blocks);
+    free(fs->allocation_table);
+    free(fs->file_metadata);
+    free(fs->name_buckets);
+    free(fs);
+}
+
+void free_filesystem(FileSystem *fs)
+{
+    if (!fs)
+        return;
+    release_filesystem(fs);
+    printf("Filesystem resources freed.\n");
+}
+
+const char *placement_policy_name(PlacementPolicy policy)
+{
+    switch (policy)
+    {
+    case PLACEMENT_BEST_FIT:
+        return "best-fit";
+    case PLACEMENT_NEXT_FIT:
+        return "next-fit";
+    case PLACEMENT_BUDDY:
+        return "buddy";
+    default:
+        return "first-fit";
+    }
+}
+
+void set_placement_policy(FileSystem *fs, PlacementPolicy policy)
+{
+    trace_op(fs, "Ad", (int)policy);
+    fs->placement_policy = policy;
+    fs->next_fit_cursor = 1;
+}
+
+// End of the free run starting at `start`: the first allocated block in
+// [start, limit), or limit if there is none.
+static int free_run_end(FileSystem *fs, int start, int limit)
+{
+    int end = start;
+    while (end < limit && !fs->allocation_table[end])
+        end++;
+    return end;
+}
+
+// Start of the first free run beginning in [from, limit) that can hold
+// blocks_needed blocks (the run may extend past limit), or -1.
+static int first_fit_from(FileSystem *fs, int from, int limit, int blocks_needed)
+{
+    for (int i = from; i < limit;)
+    {
+        if (fs->allocation_table[i])
+        {
+            i++;
+            continue;
+        }
+        // Measure no further than needed: the last run is often the whole
+        // empty tail of the volume.
+        int cap = fs->total_blocks - i > blocks_needed ? i + blocks_needed : fs->total_blocks;
+        int end = free_run_end(fs, i, cap);
+        if (end - i >= blocks_needed)
+            return i;
+        i = end;
+    }
+    return -1;
+}
+
+// Start of the smallest free run that can hold blocks_needed blocks, or -1.
+static int best_fit_start(FileSystem *fs, int blocks_needed)
+{
+    int best = -1;
+    int best_length = 0;
+    for (int i = lowest_free_block(fs); i < fs->total_blocks;)
+    {
+        if (fs->allocation_table[i])
+        {
+            i++;
+            continue;
+        }
+        int end = free_run_end(fs, i, fs->total_blocks);
+        if (end - i >= blocks_needed && (best == -1 || end - i < best_length))
+        {
+            best = i;
+            best_length = end - i;
+            if (best_length == blocks_needed)
+                break;
+        }
+        i = end;
+    }
+    return best;
+}
+
+// Buddy-style placement: requests are rounded up to a power of two and may
+// only start on a multiple of that size (counting from block 1). A wholly free
+// aligned window is preferred; otherwise the first aligned start with enough
+// free blocks is used. Only blocks_needed blocks are taken, so the tail of the
+// window stays available to smaller requests.
+static int buddy_start(FileSystem *fs, int blocks_needed)
+{
+    int size = 1;
+    while (size < blocks_needed)
+        size *= 2;
+
+    // Windows wholly below the low-water mark are full.
+    int fallback = -1;
+    for (int start = 1 + (lowest_free_block(fs) - 1) / size * size; start + blocks_needed <= fs->total_blocks; start += size)
+    {
+        int window_end = start + size < fs->total_blocks ? start + size : fs->total_blocks;
+        int end = free_run_end(fs, start, window_end);
+        if (end == window_end)
+            return start;
+        if (end - start >= blocks_needed && fallback == -1)
+            fallback = start;
+    }
+    return fallback;
+}
+
+static int contiguous_start(FileSystem *fs, int blocks_needed)
+{
+    switch (fs->placement_policy)
+    {
+    case PLACEMENT_BEST_FIT:
+        return best_fit_start(fs, blocks_needed);
+    case PLACEMENT_NEXT_FIT:
+    {
+        int start = first_fit_from(fs, fs->next_fit_cursor, fs->total_blocks, blocks_needed);
+        return start != -1 ? start : first_fit_from(fs, lowest_free_block(fs), fs->next_fit_cursor, blocks_needed);
+    }
+    case PLACEMENT_BUDDY:
+        return buddy_start(fs, blocks_needed);
+    default:
+        return first_fit_from(fs, lowest_free_block(fs), fs->total_blocks, blocks_needed);
+    }
+}
+
+typedef struct {
+    int start;
+    int length;
+} FreeRun;
+
+static int compare_runs_by_length_desc(const void *a, const void *b)
+{
+    return ((const FreeRun *)b)->length - ((const FreeRun *)a)->length;
+}
+
+static int compare_runs_by_start(const void *a, const void *b)
+{
+    return ((const FreeRun *)a)->start - ((const FreeRun *)b)->start;
+}
+
+// Best fit for a linked file that no single run can hold: take the largest
+// runs first so the chain has as few breaks as possible.
+static int largest_runs_first(FileSystem *fs, int blocks_needed, int *chosen)
+{
+    FreeRun *runs = (FreeRun *)malloc((fs->total_blocks / 2 + 1) * sizeof(FreeRun));
+    if (!runs)
+        return -1;
+    int run_count = 0;
+    for (int i = lowest_free_block(fs); i < fs->total_blocks;)
+    {
+        if (fs->allocation_table[i])
+        {
+            i++;
+            continue;
+        }
+        int end = free_run_end(fs, i, fs->total_blocks);
+        runs[run_count].start = i;
+        runs[run_count].length = end - i;
+        run_count++;
+        i = end;
+    }
+
+    qsort(runs, run_count, sizeof(FreeRun), compare_runs_by_length_desc);
+    int used_runs = 0;
+    for (int covered = 0; covered < blocks_needed && used_runs < run_count; used_runs++)
+        covered += runs[used_runs].length;
+    qsort(runs, used_runs, sizeof(FreeRun), compare_runs_by_start);
+
+    int count = 0;
+    for (int r = 0; r < used_runs; r++)
+    {
+        for (int b = runs[r].start; b < runs[r].start + runs[r].length && count < blocks_needed; b++)
+            chosen[count++] = b;
+    }
+    free(runs);
+    return count == blocks_needed ? 0 : -1;
+}
+
+// Free blocks in ascending order starting at `from`, wrapping to block 1.
+static int ascending_from(FileSystem *fs, int from, int blocks_needed, int *chosen)
+{
+    int count = 0;
+    for (int i = from; i < fs->total_blocks && count < blocks_needed; i++)
+    {
+        if (!fs->allocation_table[i])
+            chosen[count++] = i;
+    }
+    for (int i = lowest_free_block(fs); i < from && count < blocks_needed; i++)
+    {
+        if (!fs->allocation_table[i])
+            chosen[count++] = i;
+    }
+    return count == blocks_needed ? 0 : -1;
+}
+
+// Picks blocks for a new file under the current placement policy, in chain
+// order. Returns -1 if no placement exists; with enough free blocks this only
+// happens for contiguous files, when no free run is long enough.
+static int place_blocks(FileSystem *fs, int blocks_needed, bool is_contiguous, int *chosen)
+{
+    int start = -1;
+    if (is_contiguous || fs->placement_policy == PLACEMENT_BEST_FIT || fs->placement_policy == PLACEMENT_BUDDY)
+        start = contiguous_start(fs, blocks_needed);
+
+    int result = 0;
+    if (start != -1)
+    {
+        for (int i = 0; i < blocks_needed; i++)
+            chosen[i] = start + i;
+    }
+    else if (is_contiguous)
+        return -1;
+    else if (fs->placement_policy == PLACEMENT_BEST_FIT)
+        result = largest_runs_first(fs, blocks_needed, chosen);
+    else if (fs->placement_policy == PLACEMENT_NEXT_FIT)
+        result = ascending_from(fs, fs->next_fit_cursor, blocks_needed, chosen);
+    else
+        result = ascending_from(fs, lowest_free_block(fs), blocks_needed, chosen);
+
+    if (result == 0 && blocks_needed > 0)
+    {
+        fs->next_fit_cursor = chosen[blocks_needed - 1] + 1;
+        if (fs->next_fit_cursor >= fs->total_blocks)
+            fs->next_fit_cursor = 1;
+    }
+    return result;
+}
+
+// Copies `filename` into `name` as it would be stored, truncated to
+// MAX_FILENAME - 1 characters, and reports whether no file has that name yet.
+// The name index resolves a name to one file, so stored names must be unique.
+static bool file_name_available(FileSystem *fs, const char *filename, char name[MAX_FILENAME])
+{
+    strncpy(name, filename, MAX_FILENAME - 1);
+    name[MAX_FILENAME - 1] = '\0';
+    return open_file(fs, name) == -1;
+}
+
+int create_file(FileSystem *fs, const char *filename, int record_count, bool is_contiguous, bool is_sorted)
+{
+    char name[MAX_FILENAME];
+    if (!file_name_available(fs, filename, name))
+        return -1;
+
+    int records_per_block = fs->block_size;
+    int blocks_needed = (record_count + records_per_block - 1) / records_per_block;
+
+    // Compaction only moves blocks around, so it cannot help here.
+    if (fs->free_blocks < blocks_needed)
+        return -1;
+
+    int *chosen = (int *)malloc((blocks_needed > 0 ? blocks_needed : 1) * sizeof(int));
+    if (!chosen)
+        return -1;
+    if (place_blocks(fs, blocks_needed, is_contiguous, chosen) != 0)
+    {
+        // Enough free blocks, but no run is long enough: this is the case
+        // compaction exists for.
+        fs->compactions_needed++;
+        bool placed = false;
+        if (fs->compaction_prompt)
+        {
+            printf("Not enough contiguous space. Would you like to compact memory? (y/n): ");
+            char response;
+            if (scanf(" %c", &response) == 1 && (response == 'y' || response == 'Y'))
+            {
+                compact_memory_parallel(fs);
+                placed = place_blocks(fs, blocks_needed, is_contiguous, chosen) == 0;
+            }
+        }
+        if (!placed)
+        {
+            free(chosen);
+            return -1;
+        }
+    }
+
+    int handle = acquire_file_slot(fs);
+    if (handle == -1)
+    {
+        free(chosen);
+        return -1;
+    }
+    Metadata *meta = &fs->file_metadata[handle];
+    memcpy(meta->filename, name, MAX_FILENAME);
+    meta->block_count = blocks_needed;
+    meta->record_count = record_count;
+    meta->is_contiguous = is_contiguous;
+    meta->is_sorted = is_sorted;
+    meta->is_snapshot = false;
+    meta->block_list = NULL;
+    meta->data_index = NULL;
+    meta->first_block = blocks_needed > 0 ? chosen[0] : -1;
+    allocate_bloom(fs, meta);
+    index_file_name(fs, handle);
+    trace_op(fs, "Csddd", meta->filename, record_count, is_contiguous, is_sorted);
+
+    for (int i = 0; i < blocks_needed; i++)
+    {
+        fs->allocation_table[chosen[i]] = true;
+        fs->blocks[chosen[i]].owner = handle;
+        fs->blocks[chosen[i]].ref_count = 1;
+        if (!is_contiguous && i > 0)
+            fs->blocks[chosen[i - 1]].next_block = chosen[i];
+    }
+    fs->free_blocks -= blocks_needed;
+
+    free(chosen);
+    return handle;
+}
+
+int open_file(FileSystem *fs, const char *filename)
+{
+    unsigned int bucket = hash_filename(filename) % fs->bucket_count;
+    for (int handle = fs->name_buckets[bucket]; handle != -1; handle = fs->file_metadata[handle].next_in_bucket)
+    {
+        if (strcmp(fs->file_metadata[handle].filename, filename) == 0)
+            return handle;
+    }
+    return -1;
+}
+
+int create_snapshot(FileSystem *fs, const char *filename, const char *snapshot_name)
+{
+    int source = open_file(fs, filename);
+    char name[MAX_FILENAME];
+    if (source == -1 || !file_name_available(fs, snapshot_name, name))
+        return -1;
+
+    int count = fs->file_metadata[source].block_count;
+    int *block_list = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+    if (!block_list)
+        return -1;
+    int handle = acquire_file_slot(fs);
+    if (handle == -1)
+    {
+        free(block_list);
+        return -1;
+    }
+
+    // Only the block sequence is captured; the blocks themselves become shared.
+    Metadata *src = &fs->file_metadata[source];
+    Metadata *snap = &fs->file_metadata[handle];
+    int n = 0;
+    int position = 0;
+    for (int b = src->first_block; b != -1 && n < count; b = next_file_block(fs, src, b, &position))
+    {
+        block_list[n++] = b;
+        fs->blocks[b].ref_count++;
+    }
+
+    memcpy(snap->filename, name, MAX_FILENAME);
+    snap->block_count = n;
+    snap->record_count = src->record_count;
+    snap->first_block = n > 0 ? block_list[0] : -1;
+    snap->is_contiguous = false;
+    snap->is_sorted = src->is_sorted;
+    snap->is_snapshot = true;
+    snap->block_list = block_list;
+    snap->data_index = NULL; // Copying it would cost O(records); index the snapshot separately if needed
+    // The snapshot's contents are frozen, so a copy of the source filter stays exact.
+    snap->bloom_bits = 0;
+    snap->bloom = src->bloom ? (uint64_t *)malloc(src->bloom_bits / 64 * sizeof(uint64_t)) : NULL;
+    if (snap->bloom)
+    {
+        memcpy(snap->bloom, src->bloom, src->bloom_bits / 64 * sizeof(uint64_t));
+        snap->bloom_bits = src->bloom_bits;
+    }
+    index_file_name(fs, handle);
+    trace_op(fs, "Nss", src->filename, snap->filename);
+    return handle;
+}
+
+int insert_record(FileSystem *fs, const char *filename, Record record)
+{
+    return insert_record_by_handle(fs, open_file(fs, filename), record);
+}
+
+// Stores a record in block_num, which must belong to the live file and have
+// room, copying the block first if a snapshot shares it. Returns the block
+// actually written, or -1 if no block was free for the copy.
+static int store_record(FileSystem *fs, int handle, Metadata *meta, int block_num, Record record)
+{
+    block_num = make_block_writable(fs, handle, block_num);
+    if (block_num == -1)
+        return -1;
+
+    Block *block = &fs->blocks[block_num];
+    int insert_pos = block->record_count;
+    begin_block_write(block);
+
+    if (meta->is_sorted)
+    {
+        for (insert_pos = 0; insert_pos < block->record_count; insert_pos++)
+        {
+            if (block->records[insert_pos].id > record.id)
+            {
+                break;
+            }
+        }
+        for (int i = block->record_count; i > insert_pos; i--)
+        {
+            block->records[i] = block->records[i - 1];
+        }
+    }
+
+    block->records[insert_pos] = record;
+    uint64_t hash = hash_id(record.id);
+    BlockProbe probe;
+    block_filter_probe(fs, hash, &probe);
+    block_filter_add(block, &probe);
+    bloom_add(meta, hash);
+    data_index_add(meta, &record);
+    block->record_count++;
+    end_block_write(fs, block);
+    return block_num;
+}
+
+int insert_record_by_handle(FileSystem *fs, int handle, Record record)
+{
+    Metadata *meta = writable_file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+    trace_op(fs, "Isds", meta->filename, record.id, record.data);
+
+    int position = 0;
+    int current_block = meta->first_block;
+    while (current_block != -1)
+    {
+        if (fs->blocks[current_block].record_count < fs->block_size)
+            return store_record(fs, handle, meta, current_block, record) == -1 ? -1 : 0;
+        current_block = next_file_block(fs, meta, current_block, &position);
+    }
+    return -1;
+}
+
+int insert_records_by_handle(FileSystem *fs, int handle, const Record *records, int count)
+{
+    Metadata *meta = writable_file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+
+    // One walk of the chain for the whole batch: full blocks are passed over
+    // once rather than once per record.
+    int stored = 0;
+    int position = 0;
+    int current_block = meta->first_block;
+    while (stored < count)
+    {
+        while (current_block != -1 && fs->blocks[current_block].record_count >= fs->block_size)
+            current_block = next_file_block(fs, meta, current_block, &position);
+        if (current_block == -1 || (current_block = store_record(fs, handle, meta, current_block, records[stored])) == -1)
+            break;
+        trace_op(fs, "Isds", meta->filename, records[stored].id, records[stored].data);
+        stored++;
+    }
+    return stored;
+}
+
+int search_record(FileSystem *fs, const char *filename, int id, int *block_num, int *offset)
+{
+    return search_record_by_handle(fs, open_file(fs, filename), id, block_num, offset);
+}
+
+// search_record_by_handle without tracing, for internal lookups.
+static int find_record(FileSystem *fs, int handle, int id, int *block_num, int *offset)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+
+    // Most misses stop here; hits only scan blocks whose filter admits the id.
+    uint64_t hash = hash_id(id);
+    if (!bloom_may_contain(meta, hash))
+        return -1;
+    BlockProbe probe;
+    block_filter_probe(fs, hash, &probe);
+
+    int position = 0;
+    int current_block = meta->first_block;
+
+    while (current_block != -1)
+    {
+        if (!block_may_contain(&fs->blocks[current_block], &probe))
+        {
+            current_block = next_file_block(fs, meta, current_block, &position);
+            continue;
+        }
+        for (int i = 0; i < fs->blocks[current_block].record_count; i++)
+        {
+            if (!fs->blocks[current_block].records[i].is_deleted && fs->blocks[current_block].records[i].id == id)
+            {
+                *block_num = current_block;
+                *offset = i;
+                return 0;
+            }
+        }
+
+        current_block = next_file_block(fs, meta, current_block, &position);
+    }
+
+    return -1; // Record not found
+}
+
+int search_record_by_handle(FileSystem *fs, int handle, int id, int *block_num, int *offset)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (meta)
+        trace_op(fs, "Ssd", meta->filename, id);
+    return find_record(fs, handle, id, block_num, offset);
+}
+
+typedef struct {
+    int index; // Position in the caller's ids array
+    BlockProbe probe;
+} PendingLookup;
+
+int search_records_by_handle(FileSystem *fs, int handle, const int *ids, int count, int *block_nums, int *offsets)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+    for (int i = 0; i < count; i++)
+    {
+        trace_op(fs, "Ssd", meta->filename, ids[i]);
+        block_nums[i] = -1;
+        offsets[i] = -1;
+    }
+
+    // Below BATCH_SEARCH_MIN ids a shared walk saves nothing; skip the setup.
+    PendingLookup *pending = NULL;
+    if (count >= BATCH_SEARCH_MIN)
+        pending = (PendingLookup *)malloc(count * sizeof(PendingLookup));
+    if (!pending)
+    {
+        int hits = 0;
+        for (int i = 0; i < count; i++)
+            hits += find_record(fs, handle, ids[i], &block_nums[i], &offsets[i]) == 0;
+        return hits;
+    }
+
+    // Ids the file filter rules out never cost a block visit. The rest share
+    // one walk: each block is scanned only for the ids its filter admits, and
+    // an id leaves the walk once found, so repeats of an id all resolve to the
+    // first match, as find_record would.
+    int unresolved = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t hash = hash_id(ids[i]);
+        if (!bloom_may_contain(meta, hash))
+            continue;
+        pending[unresolved].index = i;
+        block_filter_probe(fs, hash, &pending[unresolved].probe);
+        unresolved++;
+    }
+
+    int hits = 0;
+    int position = 0;
+    for (int b = meta->first_block; b != -1 && unresolved > 0; b = next_file_block(fs, meta, b, &position))
+    {
+        Block *block = &fs->blocks[b];
+        for (int p = 0; p < unresolved;)
+        {
+            int found = -1;
+            if (block_may_contain(block, &pending[p].probe))
+            {
+                int id = ids[pending[p].index];
+                for (int i = 0; i < block->record_count && found == -1; i++)
+                {
+                    if (!block->records[i].is_deleted && block->records[i].id == id)
+                        found = i;
+                }
+            }
+            if (found == -1)
+            {
+                p++;
+                continue;
+            }
+            block_nums[pending[p].index] = b;
+            offsets[pending[p].index] = found;
+            hits++;
+            pending[p] = pending[--unresolved];
+        }
+    }
+    free(pending);
+    return hits;
+}
+
+void delete_record_logical(FileSystem *fs, const char *filename, int id)
+{
+    if (delete_record_logical_by_handle(fs, open_file(fs, filename), id) == 0)
+    {
+        printf("Record logically deleted.\n");
+    }
+    else
+    {
+        printf("Record not found.\n");
+    }
+}
+
+void delete_record_physical(FileSystem *fs, const char *filename, int id)
+{
+    if (delete_record_physical_by_handle(fs, open_file(fs, filename), id) == 0)
+    {
+        printf("Record physically deleted.\n");
+    }
+    else
+    {
+        printf("Record not found.\n");
+    }
+}
+
+int delete_record_logical_by_handle(FileSystem *fs, int handle, int id)
+{
+    int block_num, offset;
+    Metadata *meta = writable_file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+    trace_op(fs, "Lsd", meta->filename, id);
+    if (find_record(fs, handle, id, &block_num, &offset) != 0)
+        return -1;
+    block_num = make_block_writable(fs, handle, block_num);
+    if (block_num == -1)
+        return -1;
+
+    begin_block_write(&fs->blocks[block_num]);
+    fs->blocks[block_num].records[offset].is_deleted = true;
+    end_block_write(fs, &fs->blocks[block_num]);
+    data_index_remove(meta, &fs->blocks[block_num].records[offset]);
+    return 0;
+}
+
+int delete_record_physical_by_handle(FileSystem *fs, int handle, int id)
+{
+    int block_num, offset;
+    Metadata *meta = writable_file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+    trace_op(fs, "Psd", meta->filename, id);
+    if (find_record(fs, handle, id, &block_num, &offset) != 0)
+        return -1;
+    block_num = make_block_writable(fs, handle, block_num);
+    if (block_num == -1)
+        return -1;
+
+    data_index_remove(meta, &fs->blocks[block_num].records[offset]);
+    begin_block_write(&fs->blocks[block_num]);
+    for (int i = offset; i < fs->blocks[block_num].record_count - 1; i++)
+    {
+        fs->blocks[block_num].records[i] = fs->blocks[block_num].records[i + 1];
+    }
+    fs->blocks[block_num].record_count--;
+    end_block_write(fs, &fs->blocks[block_num]);
+    return 0;
+}
+
+int scan_file(FileSystem *fs, int handle, RecordVisitor visit, void *ctx)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+
+    int visited = 0;
+    int position = 0;
+    int current_block = meta->first_block;
+    while (current_block != -1)
+    {
+        Block *block = &fs->blocks[current_block];
+        for (int i = 0; i < block->record_count; i++)
+        {
+            if (block->records[i].is_deleted)
+                continue;
+            visited++;
+            if (!visit(&block->records[i], ctx))
+                return visited;
+        }
+        current_block = next_file_block(fs, meta, current_block, &position);
+    }
+    return visited;
+}
+
+int get_record_view(FileSystem *fs, int handle, int id, RecordView *view)
+{
+    // A lookup racing a writer can land on a record that is being shifted.
+    // Confirm the match under a stable stamp, and look again if it moved.
+    for (;;)
+    {
+        int block_num, offset;
+        if (find_record(fs, handle, id, &block_num, &offset) != 0)
+            return -1;
+        view->version = read_block_version(&fs->blocks[block_num]);
+        view->records = &fs->blocks[block_num].records[offset];
+        view->count = 1;
+        view->block_num = block_num;
+        bool matches = view->records->id == id && !view->records->is_deleted;
+        if (record_view_valid(fs, view) && matches)
+            return 0;
+    }
+}
+
+int get_block_view(FileSystem *fs, int block_num, RecordView *view)
+{
+    if (block_num <= 0 || block_num >= fs->total_blocks || !fs->allocation_table[block_num])
+        return -1;
+
+    view->version = read_block_version(&fs->blocks[block_num]);
+    view->records = fs->blocks[block_num].records;
+    view->count = fs->blocks[block_num].record_count;
+    view->block_num = block_num;
+    return 0;
+}
+
+// Seqlock reader side: the fence keeps the caller's reads through the view
+// ahead of the stamp check.
+bool record_view_valid(FileSystem *fs, const RecordView *view)
+{
+    if (view->block_num <= 0 || view->block_num >= fs->total_blocks)
+        return false;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t version = __atomic_load_n(&fs->blocks[view->block_num].version, __ATOMIC_RELAXED);
+    return version == view->version && !(version & 1);
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+int multi_get_views(FileSystem *fs, int handle, const int *ids, int id_count, RecordView *views)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+    if (id_count <= 0)
+        return 0;
+
+    // Sorted, de-duplicated copy of the wanted ids plus a found flag for each,
+    // so the file is walked once however many ids are requested.
+    int *wanted = (int *)malloc(id_count * sizeof(int));
+    bool *found = (bool *)calloc(id_count, sizeof(bool));
+    if (!wanted || !found)
+    {
+        free(wanted);
+        free(found);
+        return -1;
+    }
+    memcpy(wanted, ids, id_count * sizeof(int));
+    qsort(wanted, id_count, sizeof(int), compare_ints);
+    int unique = 1;
+    for (int i = 1; i < id_count; i++)
+    {
+        if (wanted[i] != wanted[unique - 1])
+            wanted[unique++] = wanted[i];
+    }
+
+    int hits = 0;
+    int position = 0;
+    int current_block = meta->first_block;
+    while (current_block != -1 && hits < unique)
+    {
+        Block *block = &fs->blocks[current_block];
+        // Taken before the scan, so a write during it invalidates these views.
+        uint64_t version = read_block_version(block);
+        for (int i = 0; i < block->record_count; i++)
+        {
+            if (block->records[i].is_deleted)
+                continue;
+            int *match = (int *)bsearch(&block->records[i].id, wanted, unique, sizeof(int), compare_ints);
+            if (!match || found[match - wanted])
+                continue;
+            found[match - wanted] = true;
+            views[hits].records = &block->records[i];
+            views[hits].count = 1;
+            views[hits].block_num = current_block;
+            views[hits].version = version;
+            hits++;
+        }
+        current_block = next_file_block(fs, meta, current_block, &position);
+    }
+
+    free(wanted);
+    free(found);
+    return hits;
+}
+
+// Rebuilds the data index from the surviving records. This also restores an
+// index left incomplete by an allocation failure.
+static void rebuild_data_index(FileSystem *fs, Metadata *meta)
+{
+    DataIndex *index = meta->data_index;
+    if (!index)
+        return;
+    reset_data_index(index);
+    int position = 0;
+    for (int b = meta->first_block; b != -1; b = next_file_block(fs, meta, b, &position))
+    {
+        for (int i = 0; i < fs->blocks[b].record_count; i++)
+            data_index_add(meta, &fs->blocks[b].records[i]);
+    }
+}
+
+int create_data_index_by_handle(FileSystem *fs, int handle)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+    if (meta->data_index)
+        return 0;
+    meta->data_index = (DataIndex *)calloc(1, sizeof(DataIndex));
+    if (!meta->data_index)
+        return -1;
+    rebuild_data_index(fs, meta);
+    if (!meta->data_index->complete)
+    {
+        free_data_index(meta->data_index);
+        meta->data_index = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int drop_data_index_by_handle(FileSystem *fs, int handle)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta || !meta->data_index)
+        return -1;
+    free_data_index(meta->data_index);
+    meta->data_index = NULL;
+    return 0;
+}
+
+void create_data_index(FileSystem *fs, const char *filename)
+{
+    if (create_data_index_by_handle(fs, open_file(fs, filename)) == 0)
+    {
+        printf("Data index ready.\n");
+    }
+    else
+    {
+        printf("Failed to create data index.\n");
+    }
+}
+
+void drop_data_index(FileSystem *fs, const char *filename)
+{
+    if (drop_data_index_by_handle(fs, open_file(fs, filename)) == 0)
+    {
+        printf("Data index dropped.\n");
+    }
+    else
+    {
+        printf("No data index to drop.\n");
+    }
+}
+
+static bool data_matches(const char *data, const char *key, size_t key_length, bool prefix)
+{
+    if (prefix)
+        return strncmp(data, key, key_length) == 0;
+    return strncmp(data, key, key_length + 1) == 0;
+}
+
+typedef struct {
+    const char *key;
+    size_t key_length;
+    bool prefix;
+    int *ids;
+    int max_ids;
+    int matches;
+} DataQuery;
+
+static bool collect_data_match(const Record *record, void *ctx)
+{
+    DataQuery *query = (DataQuery *)ctx;
+    if (data_matches(record->data, query->key, query->key_length, query->prefix))
+    {
+        if (query->matches < query->max_ids)
+            query->ids[query->matches] = record->id;
+        query->matches++;
+    }
+    return true;
+}
+
+// Visits entries from `from` onwards in order until one stops matching the
+// query; returns false once it has. Recursion depth is the tree height.
+static bool walk_data_index(const DataIndex *index, int node, const DataIndexEntry *from, DataQuery *query)
+{
+    while (node != -1)
+    {
+        const DataIndexNode *n = &index->nodes[node];
+        if (compare_index_entries(&n->entry, from) < 0)
+        {
+            node = n->right;
+            continue;
+        }
+        if (!walk_data_index(index, n->left, from, query))
+            return false;
+        if (!data_matches(n->entry.data, query->key, query->key_length, query->prefix))
+            return false;
+        if (query->matches < query->max_ids)
+            query->ids[query->matches] = n->entry.id;
+        query->matches++;
+        node = n->right;
+    }
+    return true;
+}
+
+int query_data_index(FileSystem *fs, int handle, const char *key, bool prefix, int *ids, int max_ids)
+{
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+
+    DataQuery query = {key, strlen(key), prefix, ids, max_ids, 0};
+    DataIndex *index = meta->data_index;
+    if (!index || !index->complete)
+    {
+        scan_file(fs, handle, collect_data_match, &query);
+        return query.matches;
+    }
+
+    // Every match sorts at or after (key, INT_MIN) and they are contiguous.
+    DataIndexEntry from;
+    make_index_entry(&from, key, INT_MIN);
+    walk_data_index(index, index->root, &from, &query);
+    return query.matches;
+}
+
+void search_by_data(FileSystem *fs, const char *filename, const char *key, bool prefix)
+{
+    int handle = open_file(fs, filename);
+    int ids[DATA_QUERY_DISPLAY_LIMIT];
+    int matches = query_data_index(fs, handle, key, prefix, ids, DATA_QUERY_DISPLAY_LIMIT);
+    if (matches == -1)
+    {
+        printf("File not found.\n");
+        return;
+    }
+    if (matches == 0)
+    {
+        printf("No matching records.\n");
+        return;
+    }
+    printf("%d matching record(s):", matches);
+    for (int i = 0; i < matches && i < DATA_QUERY_DISPLAY_LIMIT; i++)
+        printf(" %d", ids[i]);
+    printf(matches > DATA_QUERY_DISPLAY_LIMIT ? " ...\n" : "\n");
+}
+
+// Drops logically deleted records from one block, keeping the survivors in order.
+static void defragment_block(FileSystem *fs, Block *block)
+{
+    int write_pos = 0;
+    uint64_t stamp = begin_block_write(block);
+    memset(block->id_filter, 0, fs->block_filter_words * sizeof(uint64_t));
+    for (int read_pos = 0; read_pos < block->record_count; read_pos++)
+    {
+        if (!block->records[read_pos].is_deleted)
+        {
+            BlockProbe probe;
+            block_filter_probe(fs, hash_id(block->records[read_pos].id), &probe);
+            block_filter_add(block, &probe);
+            block->records[write_pos++] = block->records[read_pos];
+        }
+    }
+    bool changed = write_pos != block->record_count;
+    block->record_count = write_pos;
+    // Nothing moved: views taken before the pass stay valid.
+    if (changed)
+        end_block_write(fs, block);
+    else
+        __atomic_store_n(&block->version, stamp, __ATOMIC_RELEASE);
+}
+
+// Filters only ever gain bits on insert, so deletions leave stale bits behind
+// until defragmentation rebuilds the file filter from the surviving records.
+static void rebuild_bloom(FileSystem *fs, Metadata *meta)
+{
+    if (!meta->bloom)
+        return;
+    memset(meta->bloom, 0, meta->bloom_bits / 64 * sizeof(uint64_t));
+    int position = 0;
+    for (int b = meta->first_block; b != -1; b = next_file_block(fs, meta, b, &position))
+    {
+        for (int i = 0; i < fs->blocks[b].record_count; i++)
+        {
+            if (!fs->blocks[b].records[i].is_deleted)
+                bloom_add(meta, hash_id(fs->blocks[b].records[i].id));
+        }
+    }
+}
+
+static bool block_has_deleted(Block *block)
+{
+    for (int i = 0; i < block->record_count; i++)
+    {
+        if (block->records[i].is_deleted)
+            return true;
+    }
+    return false;
+}
+
+// Gives the file a private copy of a shared block before defragmentation would
+// modify it. Blocks without deleted records are left shared. On failure the
+// shared block is returned and must be left alone; *writable reports which.
+static int prepare_defragment_block(FileSystem *fs, int handle, int block_num, bool *writable)
+{
+    *writable = true;
+    if (fs->blocks[block_num].ref_count <= 1)
+        return block_num;
+    if (!block_has_deleted(&fs->blocks[block_num]))
+    {
+        *writable = false;
+        return block_num;
+    }
+    int copy = make_block_writable(fs, handle, block_num);
+    *writable = copy != -1;
+    return copy != -1 ? copy : block_num;
+}
+
+void defragment_file(FileSystem *fs, const char *filename)
+{
+    int file_index = open_file(fs, filename);
+    if (file_index == -1)
+        return;
+
+    Metadata *meta = writable_file_from_handle(fs, file_index);
+    if (!meta)
+    {
+        printf("Snapshots are read-only.\n");
+        return;
+    }
+    trace_op(fs, "Fs", meta->filename);
+    int position = 0;
+    int current_block = meta->first_block;
+
+    while (current_block != -1)
+    {
+        bool writable;
+        current_block = prepare_defragment_block(fs, file_index, current_block, &writable);
+        if (writable)
+            defragment_block(fs, &fs->blocks[current_block]);
+        current_block = next_file_block(fs, meta, current_block, &position);
+    }
+    rebuild_bloom(fs, meta);
+    rebuild_data_index(fs, meta);
+
+    printf("File defragmented.\n");
+}
+
+void set_thread_count(FileSystem *fs, int thread_count)
+{
+    if (thread_count < 1)
+        thread_count = 1;
+    if (thread_count == fs->thread_count)
+        return;
+    thread_pool_destroy(fs->pool);
+    fs->pool = NULL;
+    fs->thread_count = thread_count;
+}
+
+// Pool for the maintenance passes, created on first use. NULL means run inline,
+// either because one thread is configured or because the pool could not start.
+static ThreadPool *maintenance_pool(FileSystem *fs)
+{
+    if (fs->thread_count <= 1)
+        return NULL;
+    if (!fs->pool)
+        fs->pool = thread_pool_create(fs->thread_count);
+    return fs->pool;
+}
+
+// Chunk size giving each worker a few chunks to balance uneven blocks.
+static int parallel_grain(ThreadPool *pool, int count)
+{
+    int grain = count / (thread_pool_size(pool) * PARALLEL_CHUNKS_PER_THREAD);
+    return grain < 1 ? 1 : grain;
+}
+
+typedef struct {
+    FileSystem *fs;
+    int *block_list;
+} DefragmentJob;
+
+static void defragment_range(int begin, int end, void *ctx)
+{
+    DefragmentJob *job = (DefragmentJob *)ctx;
+    for (int i = begin; i < end; i++)
+    {
+        defragment_block(job->fs, &job->fs->blocks[job->block_list[i]]);
+    }
+}
+
+void defragment_file_parallel(FileSystem *fs, const char *filename)
+{
+    int file_index = open_file(fs, filename);
+    if (file_index == -1)
+        return;
+
+    ThreadPool *pool = maintenance_pool(fs);
+    Metadata *meta = writable_file_from_handle(fs, file_index);
+    if (!meta)
+    {
+        printf("Snapshots are read-only.\n");
+        return;
+    }
+    int *block_list = (int *)malloc((meta->block_count > 0 ? meta->block_count : 1) * sizeof(int));
+    if (!pool || !block_list)
+    {
+        free(block_list);
+        defragment_file(fs, filename);
+        return;
+    }
+    trace_op(fs, "Fs", meta->filename);
+
+    // Walking the chain (and copying shared blocks, which allocates) is
+    // inherently serial; filtering each block is not.
+    int count = 0;
+    int position = 0;
+    for (int b = meta->first_block; b != -1 && position < meta->block_count; b = next_file_block(fs, meta, b, &position))
+    {
+        bool writable;
+        b = prepare_defragment_block(fs, file_index, b, &writable);
+        if (writable)
+            block_list[count++] = b;
+    }
+
+    DefragmentJob job = {fs, block_list};
+    thread_pool_parallel_for(pool, 0, count, parallel_grain(pool, count), defragment_range, &job);
+    free(block_list);
+    rebuild_bloom(fs, meta);
+    rebuild_data_index(fs, meta);
+
+    printf("File defragmented.\n");
+}
+
+// Compaction slides every allocated block down, in order, to the front of the
+// volume (after the reserved block 0) and moves free blocks after them. Block
+// descriptors are permuted into a fresh array, so each records buffer keeps
+// exactly one owner, and next_block / first_block links are remapped.
+typedef struct {
+    FileSystem *fs;
+    Block *new_blocks;
+    int *remap;       // Old block index -> new block index
+    int *chunk_used;  // Allocated blocks per chunk, then the allocated blocks before it
+    int grain;        // Blocks per chunk; chunk c covers [1 + c * grain, 1 + (c + 1) * grain)
+    int used_total;
+} CompactionPlan;
+
+static void count_used_chunks(int begin, int end, void *ctx)
+{
+    CompactionPlan *plan = (CompactionPlan *)ctx;
+    for (int c = begin; c < end; c++)
+    {
+        int first = 1 + c * plan->grain;
+        int last = first + plan->grain < plan->fs->total_blocks ? first + plan->grain : plan->fs->total_blocks;
+        int used = 0;
+        for (int i = first; i < last; i++)
+        {
+            if (plan->fs->allocation_table[i])
+                used++;
+        }
+        plan->chunk_used[c] = used;
+    }
+}
+
+static void assign_chunk_targets(int begin, int end, void *ctx)
+{
+    CompactionPlan *plan = (CompactionPlan *)ctx;
+    for (int c = begin; c < end; c++)
+    {
+        int first = 1 + c * plan->grain;
+        int last = first + plan->grain < plan->fs->total_blocks ? first + plan->grain : plan->fs->total_blocks;
+        int next_used = 1 + plan->chunk_used[c];
+        int next_free = 1 + plan->used_total + (first - 1 - plan->chunk_used[c]);
+        for (int i = first; i < last; i++)
+        {
+            plan->remap[i] = plan->fs->allocation_table[i] ? next_used++ : next_free++;
+        }
+    }
+}
+
+static void move_chunk_blocks(int begin, int end, void *ctx)
+{
+    CompactionPlan *plan = (CompactionPlan *)ctx;
+    FileSystem *fs = plan->fs;
+    for (int c = begin; c < end; c++)
+    {
+        int first = 1 + c * plan->grain;
+        int last = first + plan->grain < fs->total_blocks ? first + plan->grain : fs->total_blocks;
+        for (int i = first; i < last; i++)
+        {
+            // Destinations are a permutation of the sources, so chunks never collide.
+            Block *moved = &plan->new_blocks[plan->remap[i]];
+            *moved = fs->blocks[i];
+            if (moved->next_block != -1)
+                moved->next_block = plan->remap[moved->next_block];
+            if (plan->remap[i] != i)
+                moved->version = next_version(fs);
+            fs->allocation_table[i] = i <= plan->used_total;
+        }
+    }
+}
+
+static void compact_blocks(FileSystem *fs, ThreadPool *pool)
+{
+    trace_op(fs, "M");
+    if (fs->total_blocks <= 1)
+    {
+        printf("Memory compacted successfully.\n");
+        return;
+    }
+
+    CompactionPlan plan;
+    plan.fs = fs;
+    plan.grain = pool ? parallel_grain(pool, fs->total_blocks - 1) : fs->total_blocks - 1;
+    int chunk_count = (fs->total_blocks - 1 + plan.grain - 1) / plan.grain;
+    plan.new_blocks = (Block *)malloc(fs->total_blocks * sizeof(Block));
+    plan.remap = (int *)malloc(fs->total_blocks * sizeof(int));
+    plan.chunk_used = (int *)malloc(chunk_count * sizeof(int));
+    if (!plan.new_blocks || !plan.remap || !plan.chunk_used)
+    {
+        free(plan.new_blocks);
+        free(plan.remap);
+        free(plan.chunk_used);
+        printf("Not enough memory to compact.\n");
+        return;
+    }
+
+    // Plan: count allocated blocks per chunk, then turn the counts into each
+    // chunk's starting destination with a serial prefix sum.
+    thread_pool_parallel_for(pool, 0, chunk_count, 1, count_used_chunks, &plan);
+    plan.used_total = 0;
+    for (int c = 0; c < chunk_count; c++)
+    {
+        int used = plan.chunk_used[c];
+        plan.chunk_used[c] = plan.used_total;
+        plan.used_total += used;
+    }
+    plan.remap[0] = 0;
+    thread_pool_parallel_for(pool, 0, chunk_count, 1, assign_chunk_targets, &plan);
+
+    // Move: every chunk writes a disjoint set of destinations.
+    plan.new_blocks[0] = fs->blocks[0];
+    thread_pool_parallel_for(pool, 0, chunk_count, 1, move_chunk_blocks, &plan);
+
+    for (int j = 0; j < fs->slot_count; j++)
+    {
+        Metadata *meta = &fs->file_metadata[j];
+        if (!meta->in_use)
+            continue;
+        if (meta->first_block != -1)
+            meta->first_block = plan.remap[meta->first_block];
+        if (meta->is_snapshot)
+        {
+            for (int i = 0; i < meta->block_count; i++)
+                meta->block_list[i] = plan.remap[meta->block_list[i]];
+        }
+    }
+
+    free(fs->blocks);
+    fs->blocks = plan.new_blocks;
+    fs->first_free = plan.used_total + 1;
+    free(plan.remap);
+    free(plan.chunk_used);
+    printf("Memory compacted successfully.\n");
+}
+
+void compact_memory(FileSystem *fs)
+{
+    compact_blocks(fs, NULL);
+}
 
-    fs->total_blocks = total_blocks;
-    fs->block_size = block_size;
-    fs->file_count = 0;
+void compact_memory_parallel(FileSystem *fs)
+{
+    compact_blocks(fs, maintenance_pool(fs));
+}
 
-    fs->allocation_table = (bool *)calloc(total_blocks, sizeof(bool));
-    if (!fs->allocation_table)
+static const char *block_owner_name(FileSystem *fs, int block_num)
+{
+    if (fs->blocks[block_num].owner != -1)
+        return fs->file_metadata[fs->blocks[block_num].owner].filename;
+    return block_num == 0 ? "allocation table" : "snapshots";
+}
+
+void display_memory_state(FileSystem *fs)
+{
+    for (int i = 0; i < fs->total_blocks; i++)
     {
-        free(fs);
-        return NULL;
+        if (fs->allocation_table[i])
+        {
+            printf(RED "Block %d: Occupied by %s (%d records)\n" RESET,
+                   i, block_owner_name(fs, i), fs->blocks[i].record_count);
+        }
+        else
+        {
+            printf(GREEN "Block %d: Free\n" RESET, i);
+        }
     }
-    fs->allocation_table[0] = true; // Reserve first block for allocation table
+}
 
-    fs->blocks = (Block *)malloc(total_blocks * sizeof(Block));
-    if (!fs->blocks)
+void display_metadata(FileSystem *fs)
+{
+    printf("Handle\tFilename\tBlocks\tRecords\tFirst Block\tContiguous\tSorted\tSnapshot\n");
+    for (int i = 0; i < fs->slot_count; i++)
     {
-        free(fs->allocation_table);
-        free(fs);
-        return NULL;
+        Metadata *meta = &fs->file_metadata[i];
+        if (!meta->in_use)
+            continue;
+        printf("%d\t%s\t\t%d\t%d\t%d\t\t%s\t\t%s\t%s\n",
+               i,
+               meta->filename,
+               meta->block_count,
+               meta->record_count,
+               meta->first_block,
+               meta->is_contiguous ? "Yes" : "No",
+               meta->is_sorted ? "Yes" : "No",
+               meta->is_snapshot ? "Yes" : "No");
     }
-    for (int i = 0; i < total_blocks; i++)
+}
+
+void delete_file(FileSystem *fs, const char *filename)
+{
+    if (delete_file_by_handle(fs, open_file(fs, filename)) == 0)
     {
-        fs->blocks[i].records = (Record *)malloc(block_size * sizeof(Record));
-        if (!fs->blocks[i].records)
-        {
-            for (int j = 0; j < i; j++)
-            {
-                free(fs->blocks[j].records);
-            }
-            free(fs->blocks);
-            free(fs->allocation_table);
-            free(fs);
-            return NULL;
-        }
+        printf("File deleted successfully.\n");
+    }
+    else
+    {
+        printf("File not found.\n");
+    }
+}
+
+int delete_file_by_handle(FileSystem *fs, int file_index)
+{
+    Metadata *meta = file_from_handle(fs, file_index);
+    if (!meta)
+        return -1;
+    trace_op(fs, "Ds", meta->filename);
+    int position = 0;
+    int current_block = meta->first_block;
+
+    // Blocks still shared with a snapshot (or with the live file, when deleting
+    // a snapshot) survive until their last reference goes.
+    while (current_block != -1)
+    {
+        int next_block = next_file_block(fs, meta, current_block, &position);
+        release_block(fs, current_block, file_index);
+        current_block = next_block;
+    }
+    free_file_buffers(meta);
+
+    unindex_file_name(fs, file_index);
+    release_file_slot(fs, file_index);
+    return 0;
+}
+
+void rename_file(FileSystem *fs, const char *old_name, const char *new_name)
+{
+    int file_index = open_file(fs, old_name);
+    if (file_index == -1)
+    {
+        printf("File not found.\n");
+        return;
+    }
+
+    char name[MAX_FILENAME];
+    if (!file_name_available(fs, new_name, name))
+    {
+        printf("A file with the new name already exists.\n");
+        return;
+    }
+
+    trace_op(fs, "Rss", old_name, new_name);
+    // Blocks refer to their owner by handle, so only the name index needs updating.
+    unindex_file_name(fs, file_index);
+    memcpy(fs->file_metadata[file_index].filename, name, MAX_FILENAME);
+    index_file_name(fs, file_index);
+    printf("File renamed successfully.\n");
+}
+
+static void clear_block_range(int begin, int end, void *ctx)
+{
+    FileSystem *fs = (FileSystem *)ctx;
+    for (int i = begin; i < end; i++)
+    {
+        fs->allocation_table[i] = false;
         fs->blocks[i].record_count = 0;
         fs->blocks[i].next_block = -1;
-        strcpy(fs->blocks[i].owner_file, "");
+        fs->blocks[i].owner = -1;
+        fs->blocks[i].ref_count = 0;
+        memset(fs->blocks[i].id_filter, 0, fs->block_filter_words * sizeof(uint64_t));
+        fs->blocks[i].version = next_version(fs);
     }
+}
 
-    fs->file_metadata = (Metadata *)malloc(MAX_FILES * sizeof(Metadata));
-    if (!fs->file_metadata)
+static void clear_all(FileSystem *fs, ThreadPool *pool)
+{
+    trace_op(fs, "X");
+    thread_pool_parallel_for(pool, 0, fs->total_blocks, parallel_grain(pool, fs->total_blocks), clear_block_range, fs);
+    for (int i = 0; i < fs->slot_count; i++)
     {
-        for (int i = 0; i < total_blocks; i++)
-        {
-            free(fs->blocks[i].records);
-        }
-        free(fs->blocks);
-        free(fs->allocation_table);
-        free(fs);
-        return NULL;
+        if (fs->file_metadata[i].in_use)
+            free_file_buffers(&fs->file_metadata[i]);
     }
+    for (int i = 0; i < fs->bucket_count; i++)
+        fs->name_buckets[i] = -1;
+    fs->file_count = 0;
+    fs->slot_count = 0;
+    fs->free_slot = -1;
+    fs->allocation_table[0] = true;
+    fs->free_blocks = fs->total_blocks - 1;
+    fs->first_free = 1;
+    printf("Filesystem cleared.\n");
+}
 
-    return fs;
+void clear_filesystem(FileSystem *fs)
+{
+    clear_all(fs, NULL);
 }
 
-void free_filesystem(FileSystem *fs)
+void clear_filesystem_parallel(FileSystem *fs)
 {
-    if (!fs)
+    clear_all(fs, maintenance_pool(fs));
+}
+
+void generate_sample_data(FileSystem *fs, const char *filename)
+{
+    int file_index = open_file(fs, filename);
+    if (file_index == -1)
+    {
+        printf("File not found.\n");
         return;
-    for (int i = 0; i < fs->total_blocks; i++)
+    }
+
+    Metadata *meta = &fs->file_metadata[file_index];
+    for (int i = 0; i < meta->record_count; i++)
     {
-        free(fs->blocks[i].records);
+        Record record;
+        record.id = i + 1;
+        sprintf(record.data, "Sample Data %d", i + 1);
+        record.is_deleted = false;
+        insert_record_by_handle(fs, file_index, record);
     }
-    free(fs->blocks);
-    free(fs->allocation_table);
-    free(fs->file_metadata);
-    free(fs);
-    printf("Filesystem resources freed.\n");
+
+    printf("Sample data generated for file %s.\n", filename);
 }
 
-int create_file(FileSystem *fs, const char *filename, int record_count, bool is_contiguous, bool is_sorted)
+void get_fragmentation_report(FileSystem *fs, FragmentationReport *report)
 {
-    if (fs->file_count >= MAX_FILES)
-        return -1;
+    memset(report, 0, sizeof(*report));
 
-    int records_per_block = fs->block_size;
-    int blocks_needed = (record_count + records_per_block - 1) / records_per_block;
+    for (int i = 1; i < fs->total_blocks;)
+    {
+        if (fs->allocation_table[i])
+        {
+            i++;
+            continue;
+        }
+        int end = free_run_end(fs, i, fs->total_blocks);
+        int length = end - i;
+        report->free_blocks += length;
+        report->free_runs++;
+        if (length > report->largest_free_run)
+            report->largest_free_run = length;
+        int bucket = 0;
+        while ((length >> (bucket + 1)) > 0 && bucket < FRAG_HISTOGRAM_BUCKETS - 1)
+            bucket++;
+        report->run_histogram[bucket]++;
+        i = end;
+    }
 
-    int free_blocks = 0;
-    for (int i = 1; i < fs->total_blocks; i++)
+    // Discontinuity of a linked file: the share of its chain hops that do not
+    // go to the physically next block.
+    double discontinuity_sum = 0;
+    for (int h = 0; h < fs->slot_count; h++)
     {
-        if (!fs->allocation_table[i])
-            free_blocks++;
+        Metadata *meta = &fs->file_metadata[h];
+        if (!meta->in_use || meta->is_snapshot || meta->is_contiguous || meta->block_count < 2)
+            continue;
+        int hops = 0;
+        int breaks = 0;
+        for (int b = meta->first_block; fs->blocks[b].next_block != -1; b = fs->blocks[b].next_block)
+        {
+            hops++;
+            if (fs->blocks[b].next_block != b + 1)
+                breaks++;
+        }
+        discontinuity_sum += (double)breaks / hops;
+        report->linked_files++;
+    }
+    if (report->linked_files > 0)
+        report->avg_chain_discontinuity = discontinuity_sum / report->linked_files;
+    report->compactions_needed = fs->compactions_needed;
+}
+
+void display_fragmentation_report(FileSystem *fs)
+{
+    FragmentationReport report;
+    get_fragmentation_report(fs, &report);
+
+    printf("Placement policy: %s\n", placement_policy_name(fs->placement_policy));
+    printf("Free blocks: %d in %d run(s), largest run %d\n",
+           report.free_blocks, report.free_runs, report.largest_free_run);
+    printf("Free-run histogram:\n");
+    for (int i = 0; i < FRAG_HISTOGRAM_BUCKETS; i++)
+    {
+        if (i == 0)
+            printf("  1\t%d\n", report.run_histogram[i]);
+        else if (i == FRAG_HISTOGRAM_BUCKETS - 1)
+            printf("  >= %d\t%d\n", 1 << i, report.run_histogram[i]);
+        else
+            printf("  %d-%d\t%d\n", 1 << i, (1 << (i + 1)) - 1, report.run_histogram[i]);
+    }
+    printf("Average chain discontinuity: %.2f over %d linked file(s)\n",
+           report.avg_chain_discontinuity, report.linked_files);
+    printf("Creations that needed compaction: %d\n", report.compactions_needed);
+}
+
+// xorshift32: a private generator keeps simulations reproducible and leaves
+// the global rand() state alone.
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+int simulate_churn(int total_blocks, int block_size, PlacementPolicy policy, int operations, unsigned int seed, ChurnResult *result)
+{
+    memset(result, 0, sizeof(*result));
+    FileSystem *fs = init_filesystem(total_blocks, block_size);
+    if (!fs)
+        return -1;
+    int *live = (int *)malloc((operations > 0 ? operations : 1) * sizeof(int));
+    if (!live)
+    {
+        release_filesystem(fs);
+        return -1;
     }
+    set_placement_policy(fs, policy);
+    fs->compaction_prompt = false;
 
-    if (free_blocks < blocks_needed)
+    uint32_t state = seed ? seed : 1;
+    int live_count = 0;
+    for (int op = 0; op < operations; op++)
     {
-        printf("Not enough space. Would you like to compact memory? (y/n): ");
-        char response;
-        scanf(" %c", &response);
-        if (response == 'y' || response == 'Y')
+        if (live_count == 0 || (int)(next_random(&state) % 100) < CHURN_CREATE_PERCENT)
         {
-            compact_memory(fs);
-            free_blocks = 0;
-            for (int i = 1; i < fs->total_blocks; i++)
-            {
-                if (!fs->allocation_table[i])
-                    free_blocks++;
-            }
-            if (free_blocks < blocks_needed)
-                return -1;
+            char filename[MAX_FILENAME];
+            snprintf(filename, sizeof(filename), "churn%d", op);
+            int records = 1 + (int)(next_random(&state) % (block_size * CHURN_MAX_FILE_BLOCKS));
+            bool is_contiguous = next_random(&state) % 2 == 0;
+            int handle = create_file(fs, filename, records, is_contiguous, false);
+            result->creates++;
+            if (handle >= 0)
+                live[live_count++] = handle;
+            else
+                result->failed_creates++;
         }
         else
         {
-            return -1;
+            int victim = (int)(next_random(&state) % live_count);
+            delete_file_by_handle(fs, live[victim]);
+            live[victim] = live[--live_count];
+            result->deletes++;
         }
     }
 
-    Metadata *meta = &fs->file_metadata[fs->file_count];
-    strncpy(meta->filename, filename, MAX_FILENAME - 1);
-    meta->filename[MAX_FILENAME - 1] = '\0';
-    meta->block_count = blocks_needed;
-    meta->record_count = record_count;
-    meta->is_contiguous = is_contiguous;
-    meta->is_sorted = is_sorted;
+    get_fragmentation_report(fs, &result->final);
+    free(live);
+    release_filesystem(fs);
+    return 0;
+}
 
-    if (is_contiguous)
+void compare_placement_policies(int total_blocks, int block_size, int operations, unsigned int seed)
+{
+    printf("Policy\t\tCreates\tFailed\tCompactions\tLargest Run\tFree Runs\tDiscontinuity\n");
+    for (int policy = PLACEMENT_FIRST_FIT; policy <= PLACEMENT_BUDDY; policy++)
     {
-        int start_block = -1;
-        int consecutive_free = 0;
-
-        for (int i = 1; i < fs->total_blocks && start_block == -1; i++)
+        ChurnResult result;
+        if (simulate_churn(total_blocks, block_size, (PlacementPolicy)policy, operations, seed, &result) != 0)
         {
-            if (!fs->allocation_table[i])
-            {
-                consecutive_free = 1;
-                for (int j = i + 1; j < fs->total_blocks && consecutive_free < blocks_needed; j++)
-                {
-                    if (!fs->allocation_table[j])
-                        consecutive_free++;
-                    else
-                        break;
-                }
-                if (consecutive_free >= blocks_needed)
-                    start_block = i;
-            }
+            printf("%s\t simulation failed\n", placement_policy_name((PlacementPolicy)policy));
+            continue;
         }
+        printf("%-10s\t%d\t%d\t%d\t\t%d\t\t%d\t\t%.2f\n",
+               placement_policy_name((PlacementPolicy)policy),
+               result.creates,
+               result.failed_creates,
+               result.final.compactions_needed,
+               result.final.largest_free_run,
+               result.final.free_runs,
+               result.final.avg_chain_discontinuity);
+    }
+}
+
+const char *key_distribution_name(KeyDistribution distribution)
+{
+    switch (distribution)
+    {
+    case DIST_ZIPFIAN:
+        return "zipfian";
+    case DIST_SEQUENTIAL:
+        return "sequential";
+    default:
+        return "uniform";
+    }
+}
+
+// Sizes WORKLOAD_FILES files to fill half of fs between them, leaving room for
+// file churn, with ids drawn from the same range as one file's capacity.
+void default_workload_config(FileSystem *fs, WorkloadConfig *config, KeyDistribution distribution, unsigned int seed)
+{
+    config->seed = seed;
+    config->distribution = distribution;
+    config->zipf_theta = ZIPF_DEFAULT_THETA;
+    config->read_percent = 80;
+    config->insert_percent = 12;
+    config->delete_percent = 8; // No file churn unless a caller lowers one of these
+    config->files = WORKLOAD_FILES;
+    config->file_records = (int)((long long)(fs->total_blocks - 1) * fs->block_size / (2 * WORKLOAD_FILES));
+    config->key_space = config->file_records;
+    config->operations = 100000;
+}
+
+// Zipfian ranks over [1, n] by Gray et al.'s method, as used by YCSB: O(n)
+// setup, O(1) per draw. Rank 1 is the hottest id.
+typedef struct {
+    int n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} ZipfGenerator;
+
+static int zipf_init(ZipfGenerator *zipf, int n, double theta)
+{
+    if (theta <= 0.0 || theta >= 1.0)
+        return -1;
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->zetan = 0.0;
+    for (int i = 1; i <= n; i++)
+        zipf->zetan += 1.0 / pow(i, theta);
+    double zeta2 = 1.0 + pow(0.5, theta);
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->eta = n > 1 ? (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan) : 0.0;
+    return 0;
+}
+
+static int zipf_next(const ZipfGenerator *zipf, double u)
+{
+    double uz = u * zipf->zetan;
+    if (uz < 1.0 || zipf->n == 1)
+        return 1;
+    if (uz < 1.0 + pow(0.5, zipf->theta))
+        return 2;
+    int rank = 1 + (int)(zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank > zipf->n ? zipf->n : rank;
+}
+
+static int draw_workload_id(const WorkloadConfig *config, const ZipfGenerator *zipf, uint32_t *state, int *sequential_next)
+{
+    switch (config->distribution)
+    {
+    case DIST_ZIPFIAN:
+        return zipf_next(zipf, next_random(state) / 4294967296.0);
+    case DIST_SEQUENTIAL:
+    {
+        int id = 1 + *sequential_next;
+        *sequential_next = (*sequential_next + 1) % config->key_space;
+        return id;
+    }
+    default:
+        return 1 + (int)(next_random(state) % config->key_space);
+    }
+}
+
+static Record workload_record(int id)
+{
+    Record record;
+    record.id = id;
+    snprintf(record.data, sizeof(record.data), "Workload Data %d", id);
+    record.is_deleted = false;
+    return record;
+}
 
-        if (start_block == -1)
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void finish_stats(WorkloadStats *stats, const struct timespec *start)
+{
+    stats->seconds = seconds_since(start);
+    stats->ops_per_second = stats->seconds > 0 ? stats->operations / stats->seconds : 0;
+}
+
+int run_workload(FileSystem *fs, const WorkloadConfig *config, WorkloadStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (config->key_space < 1 || config->files < 1 || config->file_records < 1 || config->operations < 0 ||
+        config->read_percent < 0 || config->insert_percent < 0 || config->delete_percent < 0 ||
+        config->read_percent + config->insert_percent + config->delete_percent > 100)
+        return -1;
+    ZipfGenerator zipf = {0};
+    if (config->distribution == DIST_ZIPFIAN && zipf_init(&zipf, config->key_space, config->zipf_theta) != 0)
+        return -1;
+    int *handles = (int *)malloc(config->files * sizeof(int));
+    if (!handles)
+        return -1;
+
+    // Setup is not timed: every file is created and filled halfway.
+    int preload = config->key_space < config->file_records / 2 ? config->key_space : config->file_records / 2;
+    for (int f = 0; f < config->files; f++)
+    {
+        char filename[MAX_FILENAME];
+        snprintf(filename, sizeof(filename), "workload%d", f);
+        handles[f] = create_file(fs, filename, config->file_records, false, false);
+        if (handles[f] == -1)
+        {
+            for (int g = 0; g < f; g++)
+                delete_file_by_handle(fs, handles[g]);
+            free(handles);
             return -1;
+        }
+        for (int id = 1; id <= preload; id++)
+            insert_record_by_handle(fs, handles[f], workload_record(id));
+    }
 
-        meta->first_block = start_block;
-        for (int i = 0; i < blocks_needed; i++)
+    uint32_t state = config->seed ? config->seed : 1;
+    int sequential_next = 0;
+    int read_limit = config->read_percent;
+    int insert_limit = read_limit + config->insert_percent;
+    int delete_limit = insert_limit + config->delete_percent;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int op = 0; op < config->operations; op++)
+    {
+        int roll = (int)(next_random(&state) % 100);
+        int slot = (int)(next_random(&state) % config->files);
+        int handle = handles[slot];
+        int block_num, offset;
+        stats->operations++;
+        if (roll < delete_limit)
+        {
+            // Drawn even if the slot's file could not be re-created, so the id stream stays the same.
+            int id = draw_workload_id(config, &zipf, &state, &sequential_next);
+            if (roll < read_limit)
+            {
+                stats->reads++;
+                if (handle != -1 && search_record_by_handle(fs, handle, id, &block_num, &offset) == 0)
+                    stats->read_hits++;
+            }
+            else if (roll < insert_limit)
+            {
+                stats->inserts++;
+                if (handle == -1 || insert_record_by_handle(fs, handle, workload_record(id)) != 0)
+                    stats->failed_inserts++;
+            }
+            else
+            {
+                stats->deletes++;
+                if (handle == -1 || delete_record_physical_by_handle(fs, handle, id) != 0)
+                    stats->failed_deletes++;
+            }
+        }
+        else
         {
-            fs->allocation_table[start_block + i] = true;
-            strncpy(fs->blocks[start_block + i].owner_file, filename, MAX_FILENAME - 1);
-            fs->blocks[start_block + i].owner_file[MAX_FILENAME - 1] = '\0';
+            // File churn: the slot's file is replaced by a new, empty one.
+            if (handle != -1)
+            {
+                delete_file_by_handle(fs, handle);
+                stats->files_deleted++;
+            }
+            char filename[MAX_FILENAME];
+            snprintf(filename, sizeof(filename), "workload%d", slot);
+            handles[slot] = create_file(fs, filename, config->file_records, false, false);
+            if (handles[slot] != -1)
+                stats->files_created++;
         }
     }
-    else
+    finish_stats(stats, &start);
+
+    for (int f = 0; f < config->files; f++)
     {
-        int prev_block = -1;
-        int allocated = 0;
+        if (handles[f] != -1)
+            delete_file_by_handle(fs, handles[f]);
+    }
+    free(handles);
+    return 0;
+}
+
+void display_workload_stats(const WorkloadStats *stats)
+{
+    printf("Operations: %lld in %.3f s (%.0f ops/s)\n", stats->operations, stats->seconds, stats->ops_per_second);
+    printf("Reads: %lld (%lld hits)\n", stats->reads, stats->read_hits);
+    printf("Inserts: %lld (%lld failed)\n", stats->inserts, stats->failed_inserts);
+    printf("Deletes: %lld (%lld failed)\n", stats->deletes, stats->failed_deletes);
+    printf("Files created: %lld, deleted: %lld\n", stats->files_created, stats->files_deleted);
+    if (stats->malformed > 0)
+        printf("Malformed trace lines skipped: %lld\n", stats->malformed);
+}
+
+int start_trace(FileSystem *fs, const char *path)
+{
+    FILE *trace = fopen(path, "w");
+    if (!trace)
+        return -1;
+    stop_trace(fs);
+    fs->trace = trace;
+    // Capacity and placement decide which operations fail and where blocks
+    // land, so a replay needs the same volume to be faithful.
+    trace_op(fs, "Vddd", fs->total_blocks, fs->block_size, (int)fs->placement_policy);
+    return 0;
+}
+
+void stop_trace(FileSystem *fs)
+{
+    if (fs->trace)
+        fclose(fs->trace);
+    fs->trace = NULL;
+}
 
-        for (int i = 1; i < fs->total_blocks && allocated < blocks_needed; i++)
+// Splits a trace line into tab-separated fields, undoing trace_string's
+// escapes in place. Returns the number of fields, or -1 if there are too many.
+static int split_trace_fields(char *line, char **fields, int max_fields)
+{
+    int count = 0;
+    char *read = line;
+    while (count < max_fields)
+    {
+        fields[count++] = read;
+        char *write = read;
+        while (*read && *read != '\t')
         {
-            if (!fs->allocation_table[i])
+            if (*read == '\\' && read[1])
+            {
+                read++;
+                *write++ = *read == 't' ? '\t' : *read == 'n' ? '\n' : *read == 'r' ? '\r' : *read;
+                read++;
+            }
+            else
             {
-                if (prev_block == -1)
-                    meta->first_block = i;
-                else
-                    fs->blocks[prev_block].next_block = i;
-
-                fs->allocation_table[i] = true;
-                strncpy(fs->blocks[i].owner_file, filename, MAX_FILENAME - 1);
-                fs->blocks[i].owner_file[MAX_FILENAME - 1] = '\0';
-                prev_block = i;
-                allocated++;
+                *write++ = *read++;
             }
         }
+        bool more = *read == '\t';
+        *write = '\0';
+        if (!more)
+            return count;
+        read++;
     }
+    return -1;
+}
 
-    fs->file_count++;
-    return 0;
+int read_trace_header(FILE *in, int *total_blocks, int *block_size)
+{
+    char line[TRACE_LINE_MAX];
+    char *fields[4];
+    if (!fgets(line, sizeof(line), in))
+        return -1;
+    line[strcspn(line, "\n")] = '\0';
+    if (split_trace_fields(line, fields, 4) != 4 || strcmp(fields[0], "V") != 0)
+        return -1;
+    *total_blocks = atoi(fields[1]);
+    *block_size = atoi(fields[2]);
+    return *total_blocks > 0 && *block_size > 0 ? 0 : -1;
 }
 
-int insert_record(FileSystem *fs, const char *filename, Record record)
+// Re-issues one traced operation; false if the line is malformed.
+static bool replay_op(FileSystem *fs, char **fields, int count, WorkloadStats *stats)
 {
-    int file_index = -1;
-    for (int i = 0; i < fs->file_count; i++)
+    if (count < 1 || fields[0][0] == '\0' || fields[0][1] != '\0')
+        return false;
+    int block_num, offset;
+    switch (fields[0][0])
     {
-        if (strcmp(fs->file_metadata[i].filename, filename) == 0)
-        {
-            file_index = i;
-            break;
-        }
+    case 'C':
+        if (count != 5)
+            return false;
+        if (create_file(fs, fields[1], atoi(fields[2]), atoi(fields[3]) != 0, atoi(fields[4]) != 0) != -1)
+            stats->files_created++;
+        return true;
+    case 'N':
+        if (count != 3)
+            return false;
+        create_snapshot(fs, fields[1], fields[2]);
+        return true;
+    case 'D':
+        if (count != 2)
+            return false;
+        if (delete_file_by_handle(fs, open_file(fs, fields[1])) == 0)
+            stats->files_deleted++;
+        return true;
+    case 'I':
+    {
+        if (count != 4)
+            return false;
+        Record record = {atoi(fields[2]), "", false};
+        strncpy(record.data, fields[3], sizeof(record.data) - 1);
+        stats->inserts++;
+        if (insert_record_by_handle(fs, open_file(fs, fields[1]), record) != 0)
+            stats->failed_inserts++;
+        return true;
     }
-    if (file_index == -1)
-        return -1;
-
-    Metadata *meta = &fs->file_metadata[file_index];
-    int current_block = meta->first_block;
-    while (current_block != -1)
+    case 'S':
+        if (count != 3)
+            return false;
+        stats->reads++;
+        if (search_record_by_handle(fs, open_file(fs, fields[1]), atoi(fields[2]), &block_num, &offset) == 0)
+            stats->read_hits++;
+        return true;
+    case 'L':
+    case 'P':
     {
-        if (fs->blocks[current_block].record_count < fs->block_size)
-        {
-            int insert_pos = fs->blocks[current_block].record_count;
+        if (count != 3)
+            return false;
+        int handle = open_file(fs, fields[1]);
+        int id = atoi(fields[2]);
+        stats->deletes++;
+        int status = fields[0][0] == 'L' ? delete_record_logical_by_handle(fs, handle, id)
+                                         : delete_record_physical_by_handle(fs, handle, id);
+        if (status != 0)
+            stats->failed_deletes++;
+        return true;
+    }
+    case 'R':
+        if (count != 3)
+            return false;
+        rename_file(fs, fields[1], fields[2]);
+        return true;
+    case 'F':
+        if (count != 2)
+            return false;
+        defragment_file(fs, fields[1]);
+        return true;
+    case 'M':
+        if (count != 1)
+            return false;
+        compact_memory(fs);
+        return true;
+    case 'X':
+        if (count != 1)
+            return false;
+        clear_filesystem(fs);
+        return true;
+    case 'V':
+    case 'A':
+    {
+        // The geometry in a 'V' header is for read_trace_header; only the
+        // placement policy can be applied to an existing volume.
+        int policy = atoi(fields[count - 1]);
+        if (count != (fields[0][0] == 'V' ? 4 : 2) || policy < PLACEMENT_FIRST_FIT || policy > PLACEMENT_BUDDY)
+            return false;
+        set_placement_policy(fs, (PlacementPolicy)policy);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
 
-            if (meta->is_sorted)
-            {
-                for (insert_pos = 0; insert_pos < fs->blocks[current_block].record_count; insert_pos++)
-                {
-                    if (fs->blocks[current_block].records[insert_pos].id > record.id)
-                    {
-                        break;
-                    }
-                }
-                for (int i = fs->blocks[current_block].record_count; i > insert_pos; i--)
-                {
-                    fs->blocks[current_block].records[i] = fs->blocks[current_block].records[i - 1];
-                }
-            }
+int replay_trace(FileSystem *fs, FILE *in, WorkloadStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    // Any compaction the recorded session agreed to is in the trace itself.
+    bool prompt = fs->compaction_prompt;
+    fs->compaction_prompt = false;
 
-            fs->blocks[current_block].records[insert_pos] = record;
-            fs->blocks[current_block].record_count++;
-            return 0;
-        }
-        if (meta->is_contiguous)
+    char line[TRACE_LINE_MAX];
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (fgets(line, sizeof(line), in))
+    {
+        size_t length = strlen(line);
+        if (length > 0 && line[length - 1] == '\n')
         {
-            current_block++;
-            if (current_block >= meta->first_block + meta->block_count)
-                break;
+            line[--length] = '\0';
         }
-        else
+        else if (!feof(in))
         {
-            current_block = fs->blocks[current_block].next_block;
+            int ch;
+            while ((ch = fgetc(in)) != '\n' && ch != EOF)
+                ;
+            stats->malformed++;
+            continue;
         }
+
+        char *fields[5];
+        int count = split_trace_fields(line, fields, 5);
+        if (replay_op(fs, fields, count, stats))
+            stats->operations++;
+        else
+            stats->malformed++;
     }
-    return -1;
+    finish_stats(stats, &start);
+
+    fs->compaction_prompt = prompt;
+    return ferror(in) ? -1 : 0;
 }
 
-int search_record(FileSystem *fs, const char *filename, int id, int *block_num, int *offset)
+int replay_trace_file(FileSystem *fs, const char *path, WorkloadStats *stats)
 {
-    int file_index = -1;
-    for (int i = 0; i < fs->file_count; i++)
-    {
-        if (strcmp(fs->file_metadata[i].filename, filename) == 0)
-        {
-            file_index = i;
-            break;
-        }
-    }
-    if (file_index == -1)
+    FILE *in = fopen(path, "r");
+    if (!in)
         return -1;
+    int status = replay_trace(fs, in, stats);
+    fclose(in);
+    return status;
+}
 
-    Metadata *meta = &fs->file_metadata[file_index];
-    int current_block = meta->first_block;
+// Buffered input: records are parsed straight out of IO_CHUNK_SIZE chunks.
+typedef struct {
+    FILE *in;
+    char *buffer;
+    size_t length; // Valid bytes in buffer
+    size_t pos;    // Next unread byte
+    bool eof;
+    bool error;
+    long long rows_read; // CSV only; used to recognise the header row
+} ChunkReader;
 
-    while (current_block != -1)
+// Moves unread bytes to the front and reads more; false once nothing new arrives.
+static bool reader_fill(ChunkReader *reader)
+{
+    if (reader->eof)
+        return false;
+    memmove(reader->buffer, reader->buffer + reader->pos, reader->length - reader->pos);
+    reader->length -= reader->pos;
+    reader->pos = 0;
+    size_t got = fread(reader->buffer + reader->length, 1, IO_CHUNK_SIZE - reader->length, reader->in);
+    reader->length += got;
+    if (got == 0)
     {
-        for (int i = 0; i < fs->blocks[current_block].record_count; i++)
-        {
-            if (!fs->blocks[current_block].records[i].is_deleted && fs->blocks[current_block].records[i].id == id)
-            {
-                *block_num = current_block;
-                *offset = i;
-                return 0;
-            }
-        }
+        reader->eof = true;
+        reader->error = ferror(reader->in) != 0;
+    }
+    return got > 0;
+}
 
-        if (meta->is_contiguous)
-        {
-            current_block++;
-            if (current_block >= meta->first_block + meta->block_count)
-                break;
-        }
-        else
-        {
-            current_block = fs->blocks[current_block].next_block;
-        }
+// Ensures at least n unread bytes are buffered; false at end of input.
+static bool reader_need(ChunkReader *reader, size_t n)
+{
+    while (reader->length - reader->pos < n)
+    {
+        if (!reader_fill(reader))
+            return false;
     }
+    return true;
+}
 
-    return -1; // Record not found
+typedef struct {
+    FILE *out;
+    char *buffer;
+    size_t length;
+    bool error;
+} ChunkWriter;
+
+static void writer_flush(ChunkWriter *writer)
+{
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->out) != writer->length)
+        writer->error = true;
+    writer->length = 0;
 }
 
-void delete_record_logical(FileSystem *fs, const char *filename, int id)
+static void writer_put(ChunkWriter *writer, const void *data, size_t n)
 {
-    int block_num, offset;
-    if (search_record(fs, filename, id, &block_num, &offset) == 0)
+    if (writer->length + n > IO_CHUNK_SIZE)
+        writer_flush(writer);
+    memcpy(writer->buffer + writer->length, data, n);
+    writer->length += n;
+}
+
+static void writer_printf(ChunkWriter *writer, const char *format, ...)
+{
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0)
+        writer_put(writer, line, length < (int)sizeof(line) ? (size_t)length : sizeof(line) - 1);
+}
+
+// Binary records: 4-byte little-endian id, 1-byte data length, data bytes.
+static void put_binary_record(ChunkWriter *writer, const Record *record)
+{
+    unsigned char header[5];
+    uint32_t id = (uint32_t)record->id;
+    size_t length = strnlen(record->data, sizeof(record->data) - 1);
+    header[0] = id & 0xff;
+    header[1] = (id >> 8) & 0xff;
+    header[2] = (id >> 16) & 0xff;
+    header[3] = (id >> 24) & 0xff;
+    header[4] = (unsigned char)length;
+    writer_put(writer, header, sizeof(header));
+    writer_put(writer, record->data, length);
+}
+
+// Returns 1 for a record, 0 at a clean end of input, -1 for a truncated record.
+static int get_binary_record(ChunkReader *reader, Record *record)
+{
+    if (!reader_need(reader, 5))
+        return reader->length == reader->pos ? 0 : -1;
+    const unsigned char *p = (const unsigned char *)reader->buffer + reader->pos;
+    uint32_t id = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    size_t length = p[4];
+    if (length >= sizeof(record->data) || !reader_need(reader, 5 + length))
+        return -1;
+
+    record->id = (int)id;
+    memcpy(record->data, reader->buffer + reader->pos + 5, length);
+    record->data[length] = '\0';
+    record->is_deleted = false;
+    reader->pos += 5 + length;
+    return 1;
+}
+
+// CSV rows are `id,data`; data is quoted (with "" for a quote) when it holds
+// a comma, quote or line break.
+static void put_csv_record(ChunkWriter *writer, const Record *record)
+{
+    char line[16 + 2 * sizeof(record->data) + 4];
+    int length = snprintf(line, sizeof(line), "%d,", record->id);
+    const char *data = record->data;
+    if (strpbrk(data, ",\"\r\n"))
     {
-        fs->blocks[block_num].records[offset].is_deleted = true;
-        printf("Record logically deleted.\n");
+        line[length++] = '"';
+        for (const char *p = data; *p; p++)
+        {
+            if (*p == '"')
+                line[length++] = '"';
+            line[length++] = *p;
+        }
+        line[length++] = '"';
     }
     else
     {
-        printf("Record not found.\n");
+        size_t n = strlen(data);
+        memcpy(line + length, data, n);
+        length += (int)n;
     }
+    line[length++] = '\n';
+    writer_put(writer, line, length);
 }
 
-void delete_record_physical(FileSystem *fs, const char *filename, int id)
+// Parses one CSV row (without its newline) into a record; false if malformed.
+static bool parse_csv_record(char *line, size_t length, Record *record)
 {
-    int block_num, offset;
-    if (search_record(fs, filename, id, &block_num, &offset) == 0)
+    if (length > 0 && line[length - 1] == '\r')
+        line[--length] = '\0';
+    char *end;
+    long id = strtol(line, &end, 10);
+    if (end == line || *end != ',')
+        return false;
+
+    const char *p = end + 1;
+    size_t out = 0;
+    if (*p == '"')
     {
-        for (int i = offset; i < fs->blocks[block_num].record_count - 1; i++)
+        for (p++; *p && !(*p == '"' && p[1] != '"'); p++)
         {
-            fs->blocks[block_num].records[i] = fs->blocks[block_num].records[i + 1];
+            if (*p == '"')
+                p++; // Doubled quote
+            if (out < sizeof(record->data) - 1)
+                record->data[out++] = *p;
         }
-        fs->blocks[block_num].record_count--;
-        printf("Record physically deleted.\n");
+        if (*p != '"')
+            return false;
     }
     else
     {
-        printf("Record not found.\n");
+        for (; *p && out < sizeof(record->data) - 1; p++)
+            record->data[out++] = *p;
     }
+    record->data[out] = '\0';
+    record->id = (int)id;
+    record->is_deleted = false;
+    return true;
 }
 
-void defragment_file(FileSystem *fs, const char *filename)
+// First newline outside a quoted field, or NULL. A doubled quote toggles
+// twice, so it needs no special case.
+static char *find_csv_row_end(char *start, size_t available)
+{
+    bool quoted = false;
+    for (size_t i = 0; i < available; i++)
+    {
+        if (start[i] == '"')
+            quoted = !quoted;
+        else if (start[i] == '\n' && !quoted)
+            return start + i;
+    }
+    return NULL;
+}
+
+// Returns 1 for a record, 0 at end of input, -1 for a malformed row (skipped).
+static int get_csv_record(ChunkReader *reader, Record *record)
 {
-    int file_index = -1;
-    for (int i = 0; i < fs->file_count; i++)
+    for (;;)
     {
-        if (strcmp(fs->file_metadata[i].filename, filename) == 0)
+        size_t available = reader->length - reader->pos;
+        char *newline = find_csv_row_end(reader->buffer + reader->pos, available);
+        if (!newline && available < IO_CHUNK_SIZE && reader_fill(reader))
+            continue;
+        if (available == 0)
+            return 0;
+        if (!newline && available == IO_CHUNK_SIZE)
         {
-            file_index = i;
-            break;
+            // A row longer than a whole chunk cannot be a record.
+            reader->pos = reader->length;
+            return -1;
         }
+
+        // reader_fill may have moved the data; the buffer has a spare byte so
+        // an unterminated final row can be terminated in place.
+        char *start = reader->buffer + reader->pos;
+        size_t length = newline ? (size_t)(newline - start) : available;
+        reader->pos += newline ? length + 1 : length;
+        start[length] = '\0';
+
+        bool is_header = reader->rows_read++ == 0 && strncmp(start, "id,", 3) == 0;
+        if (is_header || length == 0 || (length == 1 && start[0] == '\r'))
+            continue;
+        return parse_csv_record(start, length, record) ? 1 : -1;
     }
-    if (file_index == -1)
-        return;
+}
 
-    Metadata *meta = &fs->file_metadata[file_index];
-    int current_block = meta->first_block;
+int import_records(FileSystem *fs, int handle, FILE *in, RecordFormat format, TransferResult *result)
+{
+    memset(result, 0, sizeof(*result));
+    Metadata *meta = writable_file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
 
-    while (current_block != -1)
+    ChunkReader reader = {.in = in, .buffer = (char *)malloc(IO_CHUNK_SIZE + 1)};
+    if (!reader.buffer)
+        return -1;
+
+    if (format == FORMAT_BINARY && (!reader_need(&reader, 4) || memcmp(reader.buffer, BINARY_MAGIC, 4) != 0))
     {
-        int write_pos = 0;
-        for (int read_pos = 0; read_pos < fs->blocks[current_block].record_count; read_pos++)
-        {
-            if (!fs->blocks[current_block].records[read_pos].is_deleted)
-            {
-                fs->blocks[current_block].records[write_pos++] = fs->blocks[current_block].records[read_pos];
-            }
-        }
-        fs->blocks[current_block].record_count = write_pos;
+        free(reader.buffer);
+        return -1;
+    }
+    if (format == FORMAT_BINARY)
+        reader.pos = 4;
 
-        if (meta->is_contiguous)
+    // The cursor only moves forward: an import never frees space in earlier
+    // blocks, so records land exactly where repeated insert_record calls would.
+    int position = 0;
+    int current_block = meta->first_block;
+    for (;;)
+    {
+        Record record;
+        int status = format == FORMAT_BINARY ? get_binary_record(&reader, &record) : get_csv_record(&reader, &record);
+        if (status == 0)
+            break;
+        if (status < 0)
         {
-            current_block++;
-            if (current_block >= meta->first_block + meta->block_count)
-                break;
+            result->skipped++;
+            if (format == FORMAT_BINARY)
+                break; // A broken binary stream cannot be resynchronised
+            continue;
         }
-        else
+
+        while (current_block != -1 && fs->blocks[current_block].record_count >= fs->block_size)
+            current_block = next_file_block(fs, meta, current_block, &position);
+        if (current_block == -1 || (current_block = store_record(fs, handle, meta, current_block, record)) == -1)
         {
-            current_block = fs->blocks[current_block].next_block;
+            result->truncated = true;
+            break;
         }
+        trace_op(fs, "Isds", meta->filename, record.id, record.data);
+        result->records++;
     }
 
-    printf("File defragmented.\n");
+    bool failed = reader.error;
+    free(reader.buffer);
+    return failed ? -1 : 0;
 }
 
-void compact_memory(FileSystem *fs)
+int export_records(FileSystem *fs, int handle, FILE *out, RecordFormat format, TransferResult *result)
 {
-    int free_index = 1; // Start after allocation table
-    for (int i = 1; i < fs->total_blocks; i++)
+    memset(result, 0, sizeof(*result));
+    Metadata *meta = file_from_handle(fs, handle);
+    if (!meta)
+        return -1;
+
+    ChunkWriter writer = {.out = out, .buffer = (char *)malloc(IO_CHUNK_SIZE)};
+    if (!writer.buffer)
+        return -1;
+
+    if (format == FORMAT_BINARY)
+        writer_put(&writer, BINARY_MAGIC, 4);
+    else
+        writer_put(&writer, "id,data\n", 8);
+
+    int position = 0;
+    for (int b = meta->first_block; b != -1 && !writer.error; b = next_file_block(fs, meta, b, &position))
     {
-        if (fs->allocation_table[i])
+        Block *block = &fs->blocks[b];
+        for (int i = 0; i < block->record_count; i++)
         {
-            if (i != free_index)
-            {
-                fs->blocks[free_index] = fs->blocks[i];
-                fs->allocation_table[free_index] = true;
-                fs->allocation_table[i] = false;
-
-                for (int j = 0; j < fs->file_count; j++)
-                {
-                    Metadata *meta = &fs->file_metadata[j];
-                    if (meta->first_block == i)
-                    {
-                        meta->first_block = free_index;
-                    }
-                    else if (meta->is_contiguous && meta->first_block < i && i < meta->first_block + meta->block_count)
-                    {
-                        // Update the block count for contiguous files
-                        meta->block_count -= (i - free_index);
-                    }
-                }
-            }
-            free_index++;
+            if (block->records[i].is_deleted)
+                continue;
+            if (format == FORMAT_BINARY)
+                put_binary_record(&writer, &block->records[i]);
+            else
+                put_csv_record(&writer, &block->records[i]);
+            result->records++;
         }
     }
-    printf("Memory compacted successfully.\n");
+    writer_flush(&writer);
+
+    bool failed = writer.error || fflush(out) != 0;
+    free(writer.buffer);
+    return failed ? -1 : 0;
 }
 
-void display_memory_state(FileSystem *fs)
+int import_file(FileSystem *fs, const char *filename, const char *path, RecordFormat format, TransferResult *result)
 {
-    for (int i = 0; i < fs->total_blocks; i++)
-    {
-        if (fs->allocation_table[i])
-        {
-            printf(RED "Block %d: Occupied by %s (%d records)\n" RESET,
-                   i, fs->blocks[i].owner_file, fs->blocks[i].record_count);
-        }
-        else
-        {
-            printf(GREEN "Block %d: Free\n" RESET, i);
-        }
-    }
+    memset(result, 0, sizeof(*result));
+    FILE *in = fopen(path, format == FORMAT_BINARY ? "rb" : "r");
+    if (!in)
+        return -1;
+    int status = import_records(fs, open_file(fs, filename), in, format, result);
+    fclose(in);
+    return status;
 }
 
-void display_metadata(FileSystem *fs)
+int export_file(FileSystem *fs, const char *filename, const char *path, RecordFormat format, TransferResult *result)
 {
-    printf("Filename\tBlocks\tRecords\tFirst Block\tContiguous\tSorted\n");
-    for (int i = 0; i < fs->file_count; i++)
-    {
-        Metadata *meta = &fs->file_metadata[i];
-        printf("%s\t\t%d\t%d\t%d\t\t%s\t\t%s\n",
-               meta->filename,
-               meta->block_count,
-               meta->record_count,
-               meta->first_block,
-               meta->is_contiguous ? "Yes" : "No",
-               meta->is_sorted ? "Yes" : "No");
-    }
+    memset(result, 0, sizeof(*result));
+    FILE *out = fopen(path, format == FORMAT_BINARY ? "wb" : "w");
+    if (!out)
+        return -1;
+    int status = export_records(fs, open_file(fs, filename), out, format, result);
+    if (fclose(out) != 0)
+        status = -1;
+    return status;
 }
 
-void delete_file(FileSystem *fs, const char *filename)
+// A maximal run of consecutive blocks with the same state and owner.
+typedef struct {
+    int first;
+    int last;
+    bool allocated;
+    int owner;
+    long long records;
+} BlockRange;
+
+// Extends the range starting at `first` as far as the state and owner match.
+static BlockRange next_block_range(FileSystem *fs, int first)
 {
-    int file_index = -1;
-    for (int i = 0; i < fs->file_count; i++)
+    BlockRange range = {first, first, fs->allocation_table[first], fs->blocks[first].owner, 0};
+    for (int i = first; i < fs->total_blocks; i++)
     {
-        if (strcmp(fs->file_metadata[i].filename, filename) == 0)
-        {
-            file_index = i;
+        if (fs->allocation_table[i] != range.allocated || fs->blocks[i].owner != range.owner || (i == 0) != (first == 0))
             break;
-        }
-    }
-    if (file_index == -1)
-    {
-        printf("File not found.\n");
-        return;
+        range.last = i;
+        if (range.allocated)
+            range.records += fs->blocks[i].record_count;
     }
+    return range;
+}
 
-    Metadata *meta = &fs->file_metadata[file_index];
-    int current_block = meta->first_block;
+static const char *range_owner_name(FileSystem *fs, const BlockRange *range)
+{
+    if (range->owner != -1)
+        return fs->file_metadata[range->owner].filename;
+    return range->first == 0 ? "allocation table" : "snapshots";
+}
 
-    while (current_block != -1)
+static void put_page_footer(ChunkWriter *writer, int page, int page_size, long long total)
+{
+    long long pages = page_size > 0 ? (total + page_size - 1) / page_size : 1;
+    if (pages > 1)
+        writer_printf(writer, "-- page %d of %lld (%lld entries) --\n", page + 1, pages, total);
+}
+
+void display_memory_summary(FileSystem *fs, const char *owner_filter, int page, int page_size)
+{
+    ChunkWriter writer = {.out = stdout, .buffer = (char *)malloc(IO_CHUNK_SIZE)};
+    if (!writer.buffer)
+        return;
+
+    int owner = -2; // No filter
+    if (owner_filter && *owner_filter)
     {
-        fs->allocation_table[current_block] = false;
-        fs->blocks[current_block].record_count = 0;
-        strcpy(fs->blocks[current_block].owner_file, "");
-        int next_block = fs->blocks[current_block].next_block;
-        fs->blocks[current_block].next_block = -1;
-        current_block = next_block;
+        owner = open_file(fs, owner_filter);
+        if (owner == -1)
+        {
+            printf("File not found.\n");
+            free(writer.buffer);
+            return;
+        }
     }
 
-    for (int i = file_index; i < fs->file_count - 1; i++)
+    // One pass: every range is counted, only the requested page is formatted.
+    long long shown_from = page_size > 0 ? (long long)page * page_size : 0;
+    long long matched = 0;
+    int free_blocks = 0;
+    for (int i = 0; i < fs->total_blocks;)
     {
-        fs->file_metadata[i] = fs->file_metadata[i + 1];
+        BlockRange range = next_block_range(fs, i);
+        i = range.last + 1;
+        if (!range.allocated)
+            free_blocks += range.last - range.first + 1;
+        if (owner != -2 && (!range.allocated || range.owner != owner))
+            continue;
+
+        if (matched >= shown_from && (page_size <= 0 || matched < shown_from + page_size))
+        {
+            char label[64];
+            if (range.first == range.last)
+                snprintf(label, sizeof(label), "Block %d", range.first);
+            else
+                snprintf(label, sizeof(label), "Blocks %d-%d (%d)", range.first, range.last, range.last - range.first + 1);
+            if (range.allocated)
+                writer_printf(&writer, RED "%s: Occupied by %s (%lld records)\n" RESET,
+                              label, range_owner_name(fs, &range), range.records);
+            else
+                writer_printf(&writer, GREEN "%s: Free\n" RESET, label);
+        }
+        matched++;
     }
-    fs->file_count--;
-    printf("File deleted successfully.\n");
+    put_page_footer(&writer, page, page_size, matched);
+    writer_printf(&writer, "%d of %d blocks free, %d file(s)\n", free_blocks, fs->total_blocks, fs->file_count);
+
+    writer_flush(&writer);
+    fflush(stdout);
+    free(writer.buffer);
 }
 
-void rename_file(FileSystem *fs, const char *old_name, const char *new_name)
+void display_metadata_page(FileSystem *fs, int page, int page_size)
 {
-    int file_index = -1;
-    for (int i = 0; i < fs->file_count; i++)
+    ChunkWriter writer = {.out = stdout, .buffer = (char *)malloc(IO_CHUNK_SIZE)};
+    if (!writer.buffer)
+        return;
+
+    long long shown_from = page_size > 0 ? (long long)page * page_size : 0;
+    long long listed = 0;
+    writer_printf(&writer, "Handle\tFilename\tBlocks\tRecords\tFirst Block\tContiguous\tSorted\tSnapshot\n");
+    for (int i = 0; i < fs->slot_count; i++)
     {
-        if (strcmp(fs->file_metadata[i].filename, old_name) == 0)
+        Metadata *meta = &fs->file_metadata[i];
+        if (!meta->in_use)
+            continue;
+        if (listed >= shown_from && (page_size <= 0 || listed < shown_from + page_size))
         {
-            file_index = i;
-            break;
+            writer_printf(&writer, "%d\t%s\t\t%d\t%d\t%d\t\t%s\t\t%s\t%s\n",
+                          i,
+                          meta->filename,
+                          meta->block_count,
+                          meta->record_count,
+                          meta->first_block,
+                          meta->is_contiguous ? "Yes" : "No",
+                          meta->is_sorted ? "Yes" : "No",
+                          meta->is_snapshot ? "Yes" : "No");
         }
+        listed++;
     }
-    if (file_index == -1)
+    put_page_footer(&writer, page, page_size, listed);
+
+    writer_flush(&writer);
+    fflush(stdout);
+    free(writer.buffer);
+}
+
+void display_file_block_map(FileSystem *fs, const char *filename)
+{
+    int handle = open_file(fs, filename);
+    if (handle == -1)
     {
         printf("File not found.\n");
         return;
     }
+    ChunkWriter writer = {.out = stdout, .buffer = (char *)malloc(IO_CHUNK_SIZE)};
+    if (!writer.buffer)
+        return;
 
-    for (int i = 0; i < fs->file_count; i++)
+    // The file's blocks in chain order, with physically consecutive blocks
+    // collapsed into ranges.
+    Metadata *meta = &fs->file_metadata[handle];
+    writer_printf(&writer, "%s (%d blocks):", meta->filename, meta->block_count);
+    int position = 0;
+    int run_start = -1;
+    int run_end = -1;
+    int runs = 0;
+    for (int b = meta->first_block; b != -1; b = next_file_block(fs, meta, b, &position))
     {
-        if (strcmp(fs->file_metadata[i].filename, new_name) == 0)
+        if (b == run_end + 1 && run_start != -1)
         {
-            printf("A file with the new name already exists.\n");
-            return;
+            run_end = b;
+            continue;
         }
+        if (run_start != -1)
+            writer_printf(&writer, run_start == run_end ? " %d" : " %d-%d", run_start, run_end);
+        run_start = run_end = b;
+        runs++;
     }
+    if (run_start != -1)
+        writer_printf(&writer, run_start == run_end ? " %d" : " %d-%d", run_start, run_end);
+    writer_printf(&writer, "\n%d run(s)\n", runs);
 
-    strncpy(fs->file_metadata[file_index].filename, new_name, MAX_FILENAME - 1);
-    fs->file_metadata[file_index].filename[MAX_FILENAME - 1] = '\0';
-    for (int i = 0; i < fs->total_blocks; i++)
-    {
-        if (strcmp(fs->blocks[i].owner_file, old_name) == 0)
-        {
-            strncpy(fs->blocks[i].owner_file, new_name, MAX_FILENAME - 1);
-            fs->blocks[i].owner_file[MAX_FILENAME - 1] = '\0';
-        }
-    }
-    printf("File renamed successfully.\n");
+    writer_flush(&writer);
+    fflush(stdout);
+    free(writer.buffer);
 }
 
-void clear_filesystem(FileSystem *fs)
+static void put_json_string(ChunkWriter *writer, const char *text)
 {
-    for (int i = 0; i < fs->total_blocks; i++)
+    writer_put(writer, "\"", 1);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
     {
-        fs->allocation_table[i] = false;
-        fs->blocks[i].record_count = 0;
-        fs->blocks[i].next_block = -1;
-        strcpy(fs->blocks[i].owner_file, "");
+        if (*p == '"' || *p == '\\')
+        {
+            char escaped[2] = {'\\', (char)*p};
+            writer_put(writer, escaped, 2);
+        }
+        else if (*p < 0x20)
+            writer_printf(writer, "\\u%04x", *p);
+        else
+            writer_put(writer, p, 1);
     }
-    fs->file_count = 0;
-    printf("Filesystem cleared.\n");
+    writer_put(writer, "\"", 1);
 }
 
-void generate_sample_data(FileSystem *fs, const char *filename)
+int dump_filesystem_state(FileSystem *fs, FILE *out)
 {
-    int file_index = -1;
-    for (int i = 0; i < fs->file_count; i++)
-    {
-        if (strcmp(fs->file_metadata[i].filename, filename) == 0)
-        {
-            file_index = i;
-            break;
-        }
-    }
-    if (file_index == -1)
+    ChunkWriter writer = {.out = out, .buffer = (char *)malloc(IO_CHUNK_SIZE)};
+    if (!writer.buffer)
+        return -1;
+
+    writer_printf(&writer, "{\"type\":\"filesystem\",\"total_blocks\":%d,\"block_size\":%d,\"files\":%d,\"placement\":\"%s\"}\n",
+                  fs->total_blocks, fs->block_size, fs->file_count, placement_policy_name(fs->placement_policy));
+    for (int i = 0; i < fs->slot_count; i++)
     {
-        printf("File not found.\n");
-        return;
+        Metadata *meta = &fs->file_metadata[i];
+        if (!meta->in_use)
+            continue;
+        writer_printf(&writer, "{\"type\":\"file\",\"handle\":%d,\"name\":", i);
+        put_json_string(&writer, meta->filename);
+        writer_printf(&writer, ",\"blocks\":%d,\"records\":%d,\"first_block\":%d,\"contiguous\":%s,\"sorted\":%s,\"snapshot\":%s}\n",
+                      meta->block_count, meta->record_count, meta->first_block,
+                      meta->is_contiguous ? "true" : "false",
+                      meta->is_sorted ? "true" : "false",
+                      meta->is_snapshot ? "true" : "false");
     }
-
-    Metadata *meta = &fs->file_metadata[file_index];
-    srand(time(NULL));
-
-    for (int i = 0; i < meta->record_count; i++)
+    for (int i = 0; i < fs->total_blocks;)
     {
-        Record record;
-        record.id = i + 1;
-        sprintf(record.data, "Sample Data %d", i + 1);
-        record.is_deleted = false;
-        insert_record(fs, filename, record);
+        BlockRange range = next_block_range(fs, i);
+        i = range.last + 1;
+        writer_printf(&writer, "{\"type\":\"range\",\"first\":%d,\"last\":%d,\"allocated\":%s,\"owner\":%d,\"records\":%lld}\n",
+                      range.first, range.last, range.allocated ? "true" : "false", range.owner, range.records);
     }
 
-    printf("Sample data generated for file %s.\n", filename);
+    writer_flush(&writer);
+    bool failed = writer.error || fflush(out) != 0;
+    free(writer.buffer);
+    return failed ? -1 : 0;
 }
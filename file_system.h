@@ -1,23 +1,104 @@
 #ifndef FILE_SYSTEM_H
 #define FILE_SYSTEM_H
 
+#include "thread_pool.h"
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #define MAX_FILENAME 50
-#define MAX_FILES 100
-#define MAX_RECORDS 1000
+#define INITIAL_FILE_SLOTS 16 // Metadata table grows by doubling from here
+#define PARALLEL_CHUNKS_PER_THREAD 4
+#define BLOOM_BITS_PER_RECORD 10 // ~1.7% false positives with BLOOM_HASHES probes
+#define BLOOM_HASHES 3
+#define BATCH_SEARCH_MIN 2 // Shorter search_records_by_handle batches use find_record directly
+#define FRAG_HISTOGRAM_BUCKETS 8 // Free runs of 1, 2-3, 4-7, ..., >= 128 blocks
+#define CHURN_CREATE_PERCENT 55  // Share of churn operations that create a file
+#define CHURN_MAX_FILE_BLOCKS 16 // Largest file the churn simulation creates
+#define DATA_QUERY_DISPLAY_LIMIT 20 // Ids listed by search_by_data
+#define HUGE_PAGE_SIZE (2 << 20) // Huge-page backed record arenas are rounded up to this
+#define MAX_NUMA_NODES (8 * (int)sizeof(unsigned long)) // Nodes addressable by the mbind mask
+#define WORKLOAD_FILES 8          // Files a default workload cycles through
+#define ZIPF_DEFAULT_THETA 0.99   // YCSB's default skew
+#define TRACE_LINE_MAX 512        // Longest trace line replay_trace accepts
+#define IO_CHUNK_SIZE (1 << 20)  // Import/export buffer size
+#define BINARY_MAGIC "FSR1"      // Leads every binary record stream
 
 // Colors for visualization
 #define GREEN "\033[0;32m"
 #define RED "\033[0;31m"
 #define RESET "\033[0m"
 
+typedef enum {
+    PLACEMENT_FIRST_FIT, // Lowest-numbered blocks that fit
+    PLACEMENT_BEST_FIT,  // Smallest free run that fits; linked files fall back to the largest runs
+    PLACEMENT_NEXT_FIT,  // First fit, resuming after the previous allocation
+    PLACEMENT_BUDDY      // Power-of-two sized, size-aligned windows
+} PlacementPolicy;
+
+typedef enum {
+    PAGES_DEFAULT,     // Records malloc'd per block
+    PAGES_TRANSPARENT, // One arena for all records, madvise(MADV_HUGEPAGE)
+    PAGES_EXPLICIT     // One MAP_HUGETLB arena; falls back to transparent without reserved huge pages
+} PageMode;
+
+typedef enum {
+    NUMA_DEFAULT,    // Pages land on the node that first touches them
+    NUMA_INTERLEAVE, // Pages spread round-robin over all nodes
+    NUMA_BIND        // Pages restricted to numa_node
+} NumaPolicy;
+
+// Block storage placement for init_filesystem_ex. Any setting other than the
+// defaults puts all records in one mapping so the policy can cover it.
+typedef struct {
+    PageMode page_mode;
+    NumaPolicy numa_policy;
+    int numa_node; // Used by NUMA_BIND
+} StorageOptions;
+
+typedef enum {
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,   // Low ids are hottest
+    DIST_SEQUENTIAL // 1, 2, ..., key_space, then wraps
+} KeyDistribution;
+
+typedef enum {
+    FORMAT_BINARY, // BINARY_MAGIC, then per record: 4-byte little-endian id, 1-byte length, data
+    FORMAT_CSV     // "id,data" header, then one quoted-as-needed row per record
+} RecordFormat;
+
 typedef struct {
     int id;
     char data[50];
     bool is_deleted;
 } Record;
 
+typedef struct {
+    char data[50];
+    int id;
+} DataIndexEntry;
+
+typedef struct {
+    DataIndexEntry entry;
+    int left;   // Child node indices, -1 if none; left chains free nodes
+    int right;
+    int height; // AVL subtree height, 1 for a leaf
+} DataIndexNode;
+
+// Secondary index on Record::data: an AVL tree ordered by (data, id), so
+// inserts, deletes and lookups cost O(log n). Nodes live in a pool that grows
+// by doubling and reuses freed nodes.
+typedef struct {
+    DataIndexNode *nodes;
+    int root;      // -1 when empty
+    int count;     // Entries in the tree
+    int used;      // Pool slots handed out so far (high-water mark)
+    int capacity;
+    int free_node; // Head of the free-node list, -1 if empty
+    bool complete; // False after an allocation failure; queries scan the file until defragment_file rebuilds it
+} DataIndex;
+
 typedef struct {
     char filename[MAX_FILENAME];
     int block_count;
@@ -25,13 +106,24 @@ typedef struct {
     int first_block;
     bool is_contiguous;
     bool is_sorted;
+    bool in_use;        // Slot holds a live file
+    int next_free_slot; // Next slot in the free list when !in_use
+    int next_in_bucket; // Next file in the same name-index bucket, -1 at the end
+    bool is_snapshot;   // Read-only point-in-time view sharing blocks with its source
+    int *block_list;    // Snapshot's block sequence (block_count entries), NULL for live files
+    uint64_t *bloom;    // Bloom filter over inserted ids, rebuilt by defragment_file; NULL if unavailable
+    int bloom_bits;
+    DataIndex *data_index; // Optional index on record data, NULL unless created
 } Metadata;
 
 typedef struct {
     int next_block;
     Record *records;
     int record_count;
-    char owner_file[MAX_FILENAME];
+    int owner;     // Handle of the live file using the block, -1 if free or snapshot-only
+    int ref_count; // Files and snapshots referencing the block; 0 when free
+    uint64_t version;     // Seqlock stamp from version_clock: odd while the records change, new when they move or are freed
+    uint64_t *id_filter;  // Bloom filter over the block's ids: block_filter_words words of block_filters
 } Block;
 
 typedef struct {
@@ -39,26 +131,216 @@ typedef struct {
     bool *allocation_table;
     int total_blocks;
     int block_size;
-    Metadata *file_metadata;
-    int file_count;
+    int free_blocks;         // Unallocated blocks, not counting reserved block 0
+    int first_free;          // Low-water mark: every block in [1, first_free) is allocated
+    Metadata *file_metadata; // Indexed by file handle
+    int file_count;          // Live files
+    int slot_count;          // Slots handed out so far (high-water mark)
+    int slot_capacity;       // Allocated slots in file_metadata
+    int free_slot;           // Head of the free-slot list, -1 if empty
+    int *name_buckets;       // Filename hash index: bucket -> first handle, -1 if empty
+    int bucket_count;
+    int thread_count;        // Workers used by the *_parallel maintenance passes
+    ThreadPool *pool;        // Created on first parallel pass, NULL until then
+    PlacementPolicy placement_policy;
+    int next_fit_cursor;     // Where PLACEMENT_NEXT_FIT resumes searching
+    bool compaction_prompt;  // Ask before compacting when a contiguous file does not fit
+    int compactions_needed;  // Creations that failed only for want of a long enough free run
+    Record *record_arena;    // Single mapping backing every block's records, NULL if malloc'd per block
+    size_t arena_bytes;
+    StorageOptions storage;  // What init_filesystem_ex actually obtained after fallbacks
+    FILE *trace;             // Session trace being recorded, NULL when off
+    pthread_mutex_t allocation_lock; // Serialises copy-on-write block allocation across async executor threads
+    uint64_t version_clock;  // Source of block version stamps; never hands out the same one twice
+    uint64_t *block_filters; // Every block's id filter, block_filter_words words each
+    int block_filter_words;  // Sized from block_size at BLOOM_BITS_PER_RECORD bits per record
 } FileSystem;
 
+typedef struct {
+    int free_blocks;
+    int free_runs;
+    int largest_free_run;
+    int run_histogram[FRAG_HISTOGRAM_BUCKETS];
+    int linked_files;
+    double avg_chain_discontinuity; // Mean share of chain hops that skip blocks, per linked file
+    int compactions_needed;
+} FragmentationReport;
+
+typedef struct {
+    long long records; // Records imported or exported
+    long long skipped; // Malformed input records skipped
+    bool truncated;    // Import stopped because the file ran out of space
+} TransferResult;
+
+// Seeded mix of record reads, inserts and deletes over `files` files. The
+// remaining share of operations replaces a whole file with a new, empty one.
+typedef struct {
+    unsigned int seed;
+    KeyDistribution distribution;
+    double zipf_theta;  // Skew for DIST_ZIPFIAN, in (0, 1)
+    int key_space;      // Ids are drawn from [1, key_space]
+    int read_percent;
+    int insert_percent;
+    int delete_percent;
+    int files;
+    int file_records;   // Capacity of each workload file
+    int operations;
+} WorkloadConfig;
+
+typedef struct {
+    long long operations;
+    long long reads;
+    long long read_hits;
+    long long inserts;
+    long long failed_inserts;
+    long long deletes;
+    long long failed_deletes;
+    long long files_created;
+    long long files_deleted;
+    long long malformed; // Trace lines that could not be replayed
+    double seconds;
+    double ops_per_second;
+} WorkloadStats;
+
+typedef struct {
+    int creates;
+    int failed_creates; // Includes those counted in final.compactions_needed
+    int deletes;
+    FragmentationReport final;
+} ChurnResult;
+
+// Read-only window onto records stored in a block; nothing is copied. The view
+// stays usable only while record_view_valid() holds, i.e. the block has not
+// been modified, moved or freed since the view was taken. Views may be read
+// on one thread while another inserts or deletes records (e.g. through the
+// async executor): read through the view first, then call record_view_valid,
+// and discard what was read if it fails. Compaction, clearing and file
+// deletion must not run concurrently with readers.
+typedef struct {
+    const Record *records;
+    int count;
+    int block_num;
+    uint64_t version;
+} RecordView;
+
+// Called for each live record by scan_file; return false to stop the scan.
+typedef bool (*RecordVisitor)(const Record *record, void *ctx);
+
 // Function declarations
 FileSystem *init_filesystem(int total_blocks, int block_size);
+// init_filesystem with block storage options; NULL options behaves like
+// init_filesystem. Unavailable huge pages or NUMA support degrade to the
+// defaults rather than failing; check fs->storage for the result.
+FileSystem *init_filesystem_ex(int total_blocks, int block_size, const StorageOptions *options);
+const char *page_mode_name(PageMode mode);
+const char *numa_policy_name(NumaPolicy policy);
 void free_filesystem(FileSystem *fs);
+// Returns the new file's handle (index into file_metadata), or -1 on failure,
+// including when the name is already in use.
+// Handles stay valid until the file is deleted; freed slots are reused.
 int create_file(FileSystem *fs, const char *filename, int record_count, bool is_contiguous, bool is_sorted);
+int open_file(FileSystem *fs, const char *filename);
+// Returns the snapshot's handle, or -1. Costs O(blocks of the file): the blocks
+// are shared and a live file copies one only on its first write afterwards.
+// Snapshots can be read, renamed and deleted but not modified.
+int create_snapshot(FileSystem *fs, const char *filename, const char *snapshot_name);
 int insert_record(FileSystem *fs, const char *filename, Record record);
 int search_record(FileSystem *fs, const char *filename, int id, int *block_num, int *offset);
 void delete_record_logical(FileSystem *fs, const char *filename, int id);
 void delete_record_physical(FileSystem *fs, const char *filename, int id);
+
+// Handle-based variants skip name resolution. They return 0 on success and
+// -1 if the handle is not a live file or the operation fails.
+int insert_record_by_handle(FileSystem *fs, int handle, Record record);
+int search_record_by_handle(FileSystem *fs, int handle, int id, int *block_num, int *offset);
+int delete_record_logical_by_handle(FileSystem *fs, int handle, int id);
+int delete_record_physical_by_handle(FileSystem *fs, int handle, int id);
+// Batched variants that walk the file once for the whole batch.
+// insert_records_by_handle stores records in order until the file is full and
+// returns how many were stored. search_records_by_handle fills block_nums and
+// offsets for each id (-1 for misses) and returns the number of hits. Both
+// return -1 for a bad handle.
+int insert_records_by_handle(FileSystem *fs, int handle, const Record *records, int count);
+int search_records_by_handle(FileSystem *fs, int handle, const int *ids, int count, int *block_nums, int *offsets);
+// Visits live records in block order; returns the number visited, or -1.
+int scan_file(FileSystem *fs, int handle, RecordVisitor visit, void *ctx);
+
+// Zero-copy reads. get_record_view returns a one-record view; get_block_view
+// covers a whole block, including logically deleted records (check is_deleted).
+int get_record_view(FileSystem *fs, int handle, int id, RecordView *view);
+int get_block_view(FileSystem *fs, int block_num, RecordView *view);
+bool record_view_valid(FileSystem *fs, const RecordView *view);
+// Looks up many ids in one pass over the file. Fills `views` (room for
+// id_count entries) in block order and returns how many ids were found, or -1.
+int multi_get_views(FileSystem *fs, int handle, const int *ids, int id_count, RecordView *views);
+
+// Optional secondary index on Record::data, kept current by inserts, deletes
+// and defragment_file. Queries match data exactly or by prefix and write up to
+// max_ids ids (in data order when indexed) into ids. They return the total
+// number of matches, or -1 for a bad handle. Files without an index are scanned.
+int create_data_index_by_handle(FileSystem *fs, int handle);
+int drop_data_index_by_handle(FileSystem *fs, int handle);
+int query_data_index(FileSystem *fs, int handle, const char *key, bool prefix, int *ids, int max_ids);
+void create_data_index(FileSystem *fs, const char *filename);
+void drop_data_index(FileSystem *fs, const char *filename);
+void search_by_data(FileSystem *fs, const char *filename, const char *key, bool prefix);
 void defragment_file(FileSystem *fs, const char *filename);
 void rename_file(FileSystem *fs, const char *old_name, const char *new_name);
 void delete_file(FileSystem *fs, const char *filename);
+int delete_file_by_handle(FileSystem *fs, int handle);
 void compact_memory(FileSystem *fs);
 void clear_filesystem(FileSystem *fs);
+
+// Parallel maintenance passes run on a work-stealing pool of fs->thread_count
+// workers and fall back to the serial versions with a single thread.
+void set_thread_count(FileSystem *fs, int thread_count);
+void defragment_file_parallel(FileSystem *fs, const char *filename);
+void compact_memory_parallel(FileSystem *fs);
+void clear_filesystem_parallel(FileSystem *fs);
 void display_memory_state(FileSystem *fs);
 void display_metadata(FileSystem *fs);
+
+// Scalable views, each built in one pass through a buffered writer. Runs of
+// blocks with the same state and owner are collapsed into ranges. A page_size
+// of 0 shows everything; an empty owner_filter shows every range.
+void display_memory_summary(FileSystem *fs, const char *owner_filter, int page, int page_size);
+void display_metadata_page(FileSystem *fs, int page, int page_size);
+void display_file_block_map(FileSystem *fs, const char *filename);
+// Machine-readable JSON Lines: one filesystem object, then every file and block range.
+int dump_filesystem_state(FileSystem *fs, FILE *out);
+
+const char *placement_policy_name(PlacementPolicy policy);
+void set_placement_policy(FileSystem *fs, PlacementPolicy policy);
+void get_fragmentation_report(FileSystem *fs, FragmentationReport *report);
+void display_fragmentation_report(FileSystem *fs);
+// Runs a seeded create/delete workload on a private volume without prompting.
+int simulate_churn(int total_blocks, int block_size, PlacementPolicy policy, int operations, unsigned int seed, ChurnResult *result);
+void compare_placement_policies(int total_blocks, int block_size, int operations, unsigned int seed);
 void generate_sample_data(FileSystem *fs, const char *filename);
+
+// Deterministic workloads: the same config and seed issue the same operations.
+// run_workload times only the operation phase and deletes its files afterwards.
+const char *key_distribution_name(KeyDistribution distribution);
+void default_workload_config(FileSystem *fs, WorkloadConfig *config, KeyDistribution distribution, unsigned int seed);
+int run_workload(FileSystem *fs, const WorkloadConfig *config, WorkloadStats *stats);
+void display_workload_stats(const WorkloadStats *stats);
+// While a trace is recorded, file and record operations are appended to it as
+// tab-separated lines; replay_trace re-issues them against fs.
+int start_trace(FileSystem *fs, const char *path);
+void stop_trace(FileSystem *fs);
+// Every trace opens with the recording volume's geometry and placement policy.
+// Reads that header from the start of in; -1 if it is missing or malformed.
+int read_trace_header(FILE *in, int *total_blocks, int *block_size);
+int replay_trace(FileSystem *fs, FILE *in, WorkloadStats *stats);
+int replay_trace_file(FileSystem *fs, const char *path, WorkloadStats *stats);
+
+// Streaming import/export through IO_CHUNK_SIZE buffers, so memory use does
+// not depend on input size. Records go straight into (or out of) the file's
+// blocks. Return 0 on success, -1 on a bad handle, bad input header or I/O error.
+int import_records(FileSystem *fs, int handle, FILE *in, RecordFormat format, TransferResult *result);
+int export_records(FileSystem *fs, int handle, FILE *out, RecordFormat format, TransferResult *result);
+int import_file(FileSystem *fs, const char *filename, const char *path, RecordFormat format, TransferResult *result);
+int export_file(FileSystem *fs, const char *filename, const char *path, RecordFormat format, TransferResult *result);
 void menu(FileSystem *fs);
 
 #endif // FILE_SYSTEM_H
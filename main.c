@@ -48,7 +48,24 @@ void menu(FileSystem *fs)
         printf("11. Rename File\n");
         printf("12. Clear Filesystem\n");
         printf("13. Generate Sample Data\n");
-        printf("14. Quit\n");
+        printf("14. Set Thread Count\n");
+        printf("15. Create Snapshot\n");
+        printf("16. Set Placement Policy\n");
+        printf("17. Fragmentation Report\n");
+        printf("18. Compare Placement Policies\n");
+        printf("19. Import Records\n");
+        printf("20. Export Records\n");
+        printf("21. Memory Summary\n");
+        printf("22. Metadata Page\n");
+        printf("23. File Block Map\n");
+        printf("24. Dump State\n");
+        printf("25. Create Data Index\n");
+        printf("26. Search by Data\n");
+        printf("27. Drop Data Index\n");
+        printf("28. Start/Stop Trace\n");
+        printf("29. Replay Trace\n");
+        printf("30. Run Workload\n");
+        printf("31. Quit\n");
         printf("Enter your choice: ");
 
         choice = get_integer_input();
@@ -79,12 +96,41 @@ void menu(FileSystem *fs)
                 break;
             }
 
+            StorageOptions options = {PAGES_DEFAULT, NUMA_DEFAULT, -1};
+            printf("Enter page mode (0 default, 1 transparent huge pages, 2 explicit huge pages): ");
+            int page_mode = get_integer_input();
+            if (page_mode < PAGES_DEFAULT || page_mode > PAGES_EXPLICIT)
+            {
+                printf("Invalid input. Please enter a number from 0 to 2.\n");
+                break;
+            }
+            options.page_mode = (PageMode)page_mode;
+            printf("Enter NUMA policy (0 default, 1 interleave, 2 bind): ");
+            int numa_policy = get_integer_input();
+            if (numa_policy < NUMA_DEFAULT || numa_policy > NUMA_BIND)
+            {
+                printf("Invalid input. Please enter a number from 0 to 2.\n");
+                break;
+            }
+            options.numa_policy = (NumaPolicy)numa_policy;
+            if (options.numa_policy == NUMA_BIND)
+            {
+                printf("Enter NUMA node: ");
+                options.numa_node = get_integer_input();
+                if (options.numa_node < 0)
+                {
+                    printf("Invalid input. Please enter a non-negative integer.\n");
+                    break;
+                }
+            }
+
             if (fs)
                 free_filesystem(fs);
-            fs = init_filesystem(blocks, size);
+            fs = init_filesystem_ex(blocks, size, &options);
             if (fs)
             {
-                printf("Filesystem initialized.\n");
+                printf("Filesystem initialized (%s, NUMA %s).\n",
+                       page_mode_name(fs->storage.page_mode), numa_policy_name(fs->storage.numa_policy));
             }
             else
             {
@@ -130,13 +176,14 @@ void menu(FileSystem *fs)
                 break;
             }
 
-            if (create_file(fs, filename, records, contiguous, sorted) == 0)
+            int handle = create_file(fs, filename, records, contiguous, sorted);
+            if (handle >= 0)
             {
-                printf("File created successfully.\n");
+                printf("File created successfully (handle %d).\n", handle);
             }
             else
             {
-                printf("Failed to create file.\n");
+                printf("Failed to create file: the name is in use or there is not enough space.\n");
             }
             break;
         }
@@ -263,11 +310,11 @@ void menu(FileSystem *fs)
                 break;
             }
             filename[strcspn(filename, "\n")] = 0; // Remove newline if present
-            defragment_file(fs, filename);
+            defragment_file_parallel(fs, filename);
             break;
         }
         case 9:
-            compact_memory(fs);
+            compact_memory_parallel(fs);
             break;
         case 10:
         {
@@ -305,7 +352,7 @@ void menu(FileSystem *fs)
             break;
         }
         case 12:
-            clear_filesystem(fs);
+            clear_filesystem_parallel(fs);
             break;
         case 13:
         {
@@ -321,12 +368,363 @@ void menu(FileSystem *fs)
             break;
         }
         case 14:
+        {
+            printf("Enter thread count for maintenance passes: ");
+            int threads = get_integer_input();
+            if (threads <= 0)
+            {
+                printf("Invalid input. Please enter a positive integer.\n");
+                break;
+            }
+            set_thread_count(fs, threads);
+            printf("Using %d thread(s).\n", threads);
+            break;
+        }
+        case 15:
+        {
+            char filename[MAX_FILENAME], snapshot_name[MAX_FILENAME];
+            printf("Enter filename to snapshot: ");
+            if (fgets(filename, sizeof(filename), stdin) == NULL)
+            {
+                printf("Error reading filename.\n");
+                break;
+            }
+            filename[strcspn(filename, "\n")] = 0; // Remove newline if present
+
+            printf("Enter snapshot name: ");
+            if (fgets(snapshot_name, sizeof(snapshot_name), stdin) == NULL)
+            {
+                printf("Error reading snapshot name.\n");
+                break;
+            }
+            snapshot_name[strcspn(snapshot_name, "\n")] = 0; // Remove newline if present
+
+            int handle = create_snapshot(fs, filename, snapshot_name);
+            if (handle >= 0)
+            {
+                printf("Snapshot created (handle %d).\n", handle);
+            }
+            else
+            {
+                printf("Failed to create snapshot.\n");
+            }
+            break;
+        }
+        case 16:
+        {
+            printf("Enter placement policy (0 first-fit, 1 best-fit, 2 next-fit, 3 buddy): ");
+            int policy = get_integer_input();
+            if (policy < PLACEMENT_FIRST_FIT || policy > PLACEMENT_BUDDY)
+            {
+                printf("Invalid input. Please enter a number from 0 to 3.\n");
+                break;
+            }
+            set_placement_policy(fs, (PlacementPolicy)policy);
+            printf("Placement policy set to %s.\n", placement_policy_name((PlacementPolicy)policy));
+            break;
+        }
+        case 17:
+            display_fragmentation_report(fs);
+            break;
+        case 18:
+        {
+            printf("Enter number of create/delete operations to simulate: ");
+            int operations = get_integer_input();
+            if (operations <= 0)
+            {
+                printf("Invalid input. Please enter a positive integer.\n");
+                break;
+            }
+            compare_placement_policies(fs->total_blocks, fs->block_size, operations, 1);
+            break;
+        }
+        case 19:
+        case 20:
+        {
+            char filename[MAX_FILENAME], path[256];
+            printf("Enter filename: ");
+            if (fgets(filename, sizeof(filename), stdin) == NULL)
+            {
+                printf("Error reading filename.\n");
+                break;
+            }
+            filename[strcspn(filename, "\n")] = 0; // Remove newline if present
+
+            printf(choice == 19 ? "Enter path to import from: " : "Enter path to export to: ");
+            if (fgets(path, sizeof(path), stdin) == NULL)
+            {
+                printf("Error reading path.\n");
+                break;
+            }
+            path[strcspn(path, "\n")] = 0; // Remove newline if present
+
+            printf("Enter format (1 for binary, 2 for CSV): ");
+            int format = get_integer_input();
+            if (format != 1 && format != 2)
+            {
+                printf("Invalid format. Please enter 1 or 2.\n");
+                break;
+            }
+
+            TransferResult result;
+            RecordFormat record_format = format == 1 ? FORMAT_BINARY : FORMAT_CSV;
+            if (choice == 19)
+            {
+                if (import_file(fs, filename, path, record_format, &result) == 0)
+                {
+                    printf("Imported %lld record(s), skipped %lld malformed.\n", result.records, result.skipped);
+                    if (result.truncated)
+                        printf("File is full; the rest of the input was not imported.\n");
+                }
+                else
+                {
+                    printf("Import failed.\n");
+                }
+            }
+            else
+            {
+                if (export_file(fs, filename, path, record_format, &result) == 0)
+                {
+                    printf("Exported %lld record(s).\n", result.records);
+                }
+                else
+                {
+                    printf("Export failed.\n");
+                }
+            }
+            break;
+        }
+        case 21:
+        case 22:
+        {
+            char owner[MAX_FILENAME] = "";
+            if (choice == 21)
+            {
+                printf("Enter filename to filter by (blank for all): ");
+                if (fgets(owner, sizeof(owner), stdin) == NULL)
+                {
+                    printf("Error reading filename.\n");
+                    break;
+                }
+                owner[strcspn(owner, "\n")] = 0; // Remove newline if present
+            }
+
+            printf("Enter page size (0 for everything): ");
+            int page_size = get_integer_input();
+            if (page_size < 0)
+            {
+                printf("Invalid input. Please enter a non-negative integer.\n");
+                break;
+            }
+            int page = 0;
+            if (page_size > 0)
+            {
+                printf("Enter page number (starting at 1): ");
+                page = get_integer_input() - 1;
+                if (page < 0)
+                {
+                    printf("Invalid input. Please enter a positive integer.\n");
+                    break;
+                }
+            }
+
+            if (choice == 21)
+                display_memory_summary(fs, owner, page, page_size);
+            else
+                display_metadata_page(fs, page, page_size);
+            break;
+        }
+        case 23:
+        {
+            char filename[MAX_FILENAME];
+            printf("Enter filename to map: ");
+            if (fgets(filename, sizeof(filename), stdin) == NULL)
+            {
+                printf("Error reading filename.\n");
+                break;
+            }
+            filename[strcspn(filename, "\n")] = 0; // Remove newline if present
+            display_file_block_map(fs, filename);
+            break;
+        }
+        case 24:
+        {
+            char path[256];
+            printf("Enter path to dump to: ");
+            if (fgets(path, sizeof(path), stdin) == NULL)
+            {
+                printf("Error reading path.\n");
+                break;
+            }
+            path[strcspn(path, "\n")] = 0; // Remove newline if present
+
+            FILE *out = fopen(path, "w");
+            if (!out)
+            {
+                printf("Could not open %s.\n", path);
+                break;
+            }
+            int status = dump_filesystem_state(fs, out);
+            if (fclose(out) != 0 || status != 0)
+            {
+                printf("Dump failed.\n");
+            }
+            else
+            {
+                printf("State written to %s.\n", path);
+            }
+            break;
+        }
+        case 25:
+        case 27:
+        {
+            char filename[MAX_FILENAME];
+            printf("Enter filename: ");
+            if (fgets(filename, sizeof(filename), stdin) == NULL)
+            {
+                printf("Error reading filename.\n");
+                break;
+            }
+            filename[strcspn(filename, "\n")] = 0; // Remove newline if present
+            if (choice == 25)
+                create_data_index(fs, filename);
+            else
+                drop_data_index(fs, filename);
+            break;
+        }
+        case 26:
+        {
+            char filename[MAX_FILENAME], key[50];
+            printf("Enter filename to search: ");
+            if (fgets(filename, sizeof(filename), stdin) == NULL)
+            {
+                printf("Error reading filename.\n");
+                break;
+            }
+            filename[strcspn(filename, "\n")] = 0; // Remove newline if present
+
+            printf("Enter data to search for: ");
+            if (fgets(key, sizeof(key), stdin) == NULL)
+            {
+                printf("Error reading data.\n");
+                break;
+            }
+            key[strcspn(key, "\n")] = 0; // Remove newline if present
+
+            printf("Match exactly or by prefix? (1 for exact, 2 for prefix): ");
+            int mode = get_integer_input();
+            if (mode != 1 && mode != 2)
+            {
+                printf("Invalid input. Please enter 1 or 2.\n");
+                break;
+            }
+            search_by_data(fs, filename, key, mode == 2);
+            break;
+        }
+        case 28:
+        {
+            if (fs->trace)
+            {
+                stop_trace(fs);
+                printf("Trace stopped.\n");
+                break;
+            }
+            char path[256];
+            printf("Enter path to record the trace to: ");
+            if (fgets(path, sizeof(path), stdin) == NULL)
+            {
+                printf("Error reading path.\n");
+                break;
+            }
+            path[strcspn(path, "\n")] = 0; // Remove newline if present
+            if (start_trace(fs, path) == 0)
+            {
+                printf("Recording operations to %s.\n", path);
+            }
+            else
+            {
+                printf("Could not open %s.\n", path);
+            }
+            break;
+        }
+        case 29:
+        {
+            char path[256];
+            printf("Enter path of the trace to replay: ");
+            if (fgets(path, sizeof(path), stdin) == NULL)
+            {
+                printf("Error reading path.\n");
+                break;
+            }
+            path[strcspn(path, "\n")] = 0; // Remove newline if present
+
+            FILE *in = fopen(path, "r");
+            int total_blocks, block_size;
+            if (in && read_trace_header(in, &total_blocks, &block_size) == 0 &&
+                (total_blocks != fs->total_blocks || block_size != fs->block_size))
+            {
+                printf("Note: the trace was recorded on %d blocks of %d records; this filesystem has %d blocks of %d.\n",
+                       total_blocks, block_size, fs->total_blocks, fs->block_size);
+            }
+            if (in)
+                fclose(in);
+
+            WorkloadStats stats;
+            if (replay_trace_file(fs, path, &stats) == 0)
+            {
+                display_workload_stats(&stats);
+            }
+            else
+            {
+                printf("Replay failed.\n");
+            }
+            break;
+        }
+        case 30:
+        {
+            printf("Enter key distribution (0 uniform, 1 zipfian, 2 sequential): ");
+            int distribution = get_integer_input();
+            if (distribution < DIST_UNIFORM || distribution > DIST_SEQUENTIAL)
+            {
+                printf("Invalid input. Please enter a number from 0 to 2.\n");
+                break;
+            }
+            printf("Enter seed: ");
+            int seed = get_integer_input();
+            if (seed < 0)
+            {
+                printf("Invalid input. Please enter a non-negative integer.\n");
+                break;
+            }
+            printf("Enter number of operations: ");
+            int operations = get_integer_input();
+            if (operations <= 0)
+            {
+                printf("Invalid input. Please enter a positive integer.\n");
+                break;
+            }
+
+            WorkloadConfig config;
+            default_workload_config(fs, &config, (KeyDistribution)distribution, (unsigned int)seed);
+            config.operations = operations;
+            WorkloadStats stats;
+            if (run_workload(fs, &config, &stats) == 0)
+            {
+                display_workload_stats(&stats);
+            }
+            else
+            {
+                printf("Workload failed: the filesystem is too small or its files clash with the workload's.\n");
+            }
+            break;
+        }
+        case 31:
             printf("Exiting simulator...\n");
             break;
         default:
             printf("Invalid choice. Try again.\n");
         }
-    } while (choice != 14);
+    } while (choice != 31);
 }
 
 int main()
@@ -0,0 +1,363 @@
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define INITIAL_DEQUE_CAPACITY 64
+
+typedef struct {
+    TaskFunc fn;
+    void *arg;
+} Task;
+
+typedef struct {
+    Task *tasks; // Ring buffer
+    int capacity;
+    int head;    // Oldest task; thieves take from here
+    int count;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+typedef struct {
+    ThreadPool *pool;
+    int index;
+} WorkerArg;
+
+struct ThreadPool {
+    pthread_t *threads;
+    WorkerArg *worker_args;
+    TaskDeque *deques; // One per worker
+    int thread_count;
+    int next_deque;    // Round-robin target for submissions from outside the pool
+    int queued;        // Tasks sitting in deques
+    int pending;       // Tasks submitted but not yet finished
+    bool shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t all_done;
+};
+
+// Lets tasks submitted from a worker land on that worker's own deque.
+static _Thread_local ThreadPool *current_pool = NULL;
+static _Thread_local int current_worker = -1;
+
+static int deque_init(TaskDeque *dq)
+{
+    dq->tasks = (Task *)malloc(INITIAL_DEQUE_CAPACITY * sizeof(Task));
+    if (!dq->tasks)
+        return -1;
+    dq->capacity = INITIAL_DEQUE_CAPACITY;
+    dq->head = 0;
+    dq->count = 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return 0;
+}
+
+static void deque_destroy(TaskDeque *dq)
+{
+    free(dq->tasks);
+    pthread_mutex_destroy(&dq->lock);
+}
+
+static int deque_push_bottom(TaskDeque *dq, Task task)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->capacity)
+    {
+        int new_capacity = dq->capacity * 2;
+        Task *grown = (Task *)malloc(new_capacity * sizeof(Task));
+        if (!grown)
+        {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
+        }
+        for (int i = 0; i < dq->count; i++)
+            grown[i] = dq->tasks[(dq->head + i) % dq->capacity];
+        free(dq->tasks);
+        dq->tasks = grown;
+        dq->capacity = new_capacity;
+        dq->head = 0;
+    }
+    dq->tasks[(dq->head + dq->count) % dq->capacity] = task;
+    dq->count++;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+static bool deque_pop_bottom(TaskDeque *dq, Task *task)
+{
+    pthread_mutex_lock(&dq->lock);
+    bool found = dq->count > 0;
+    if (found)
+    {
+        dq->count--;
+        *task = dq->tasks[(dq->head + dq->count) % dq->capacity];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static bool deque_steal_top(TaskDeque *dq, Task *task)
+{
+    pthread_mutex_lock(&dq->lock);
+    bool found = dq->count > 0;
+    if (found)
+    {
+        *task = dq->tasks[dq->head];
+        dq->head = (dq->head + 1) % dq->capacity;
+        dq->count--;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static bool take_task(ThreadPool *pool, int self, Task *task)
+{
+    bool found = deque_pop_bottom(&pool->deques[self], task);
+    for (int i = 1; !found && i < pool->thread_count; i++)
+    {
+        found = deque_steal_top(&pool->deques[(self + i) % pool->thread_count], task);
+    }
+    if (found)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return found;
+}
+
+static void *worker_main(void *arg)
+{
+    WorkerArg *worker = (WorkerArg *)arg;
+    ThreadPool *pool = worker->pool;
+    current_pool = pool;
+    current_worker = worker->index;
+
+    for (;;)
+    {
+        Task task;
+        if (take_task(pool, worker->index, &task))
+        {
+            task.fn(task.arg);
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0)
+                pthread_cond_broadcast(&pool->all_done);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->shutdown)
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        bool exit_worker = pool->shutdown && pool->queued == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (exit_worker)
+            return NULL;
+    }
+}
+
+ThreadPool *thread_pool_create(int thread_count)
+{
+    if (thread_count < 1)
+        return NULL;
+
+    ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+    if (!pool)
+        return NULL;
+    pool->threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+    pool->worker_args = (WorkerArg *)malloc(thread_count * sizeof(WorkerArg));
+    pool->deques = (TaskDeque *)malloc(thread_count * sizeof(TaskDeque));
+    if (!pool->threads || !pool->worker_args || !pool->deques)
+    {
+        free(pool->threads);
+        free(pool->worker_args);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < thread_count; i++)
+    {
+        if (deque_init(&pool->deques[i]) != 0)
+        {
+            for (int j = 0; j < i; j++)
+                deque_destroy(&pool->deques[j]);
+            free(pool->threads);
+            free(pool->worker_args);
+            free(pool->deques);
+            free(pool);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+
+    pool->thread_count = thread_count;
+    for (int i = 0; i < thread_count; i++)
+    {
+        pool->worker_args[i].pool = pool;
+        pool->worker_args[i].index = i;
+    }
+    for (int i = 0; i < thread_count; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->worker_args[i]) != 0)
+        {
+            pthread_mutex_lock(&pool->lock);
+            pool->shutdown = true;
+            pthread_cond_broadcast(&pool->work_available);
+            pthread_mutex_unlock(&pool->lock);
+            for (int j = 0; j < i; j++)
+                pthread_join(pool->threads[j], NULL);
+            pool->thread_count = 0;
+            for (int j = 0; j < thread_count; j++)
+                deque_destroy(&pool->deques[j]);
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for (int i = 0; i < pool->thread_count; i++)
+        deque_destroy(&pool->deques[i]);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->all_done);
+    free(pool->threads);
+    free(pool->worker_args);
+    free(pool->deques);
+    free(pool);
+}
+
+int thread_pool_size(ThreadPool *pool)
+{
+    return pool ? pool->thread_count : 1;
+}
+
+int thread_pool_submit(ThreadPool *pool, TaskFunc fn, void *arg)
+{
+    Task task = {fn, arg};
+
+    pthread_mutex_lock(&pool->lock);
+    int target = current_worker;
+    if (current_pool != pool)
+    {
+        target = pool->next_deque;
+        pool->next_deque = (pool->next_deque + 1) % pool->thread_count;
+    }
+    pool->pending++;
+    pool->queued++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (deque_push_bottom(&pool->deques[target], task) != 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->all_done);
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void thread_pool_wait(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int remaining;
+} RangeGroup;
+
+typedef struct {
+    RangeFunc fn;
+    void *ctx;
+    int begin;
+    int end;
+    RangeGroup *group;
+} RangeTask;
+
+static void run_range_task(void *arg)
+{
+    RangeTask *task = (RangeTask *)arg;
+    task->fn(task->begin, task->end, task->ctx);
+
+    pthread_mutex_lock(&task->group->lock);
+    if (--task->group->remaining == 0)
+        pthread_cond_signal(&task->group->done);
+    pthread_mutex_unlock(&task->group->lock);
+}
+
+void thread_pool_parallel_for(ThreadPool *pool, int begin, int end, int grain, RangeFunc fn, void *ctx)
+{
+    if (end <= begin)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    int chunk_count = (end - begin + grain - 1) / grain;
+    // Run inline without a pool, for a single chunk, or when called from one of
+    // this pool's own workers (blocking a worker on its siblings could deadlock).
+    if (!pool || chunk_count == 1 || current_pool == pool)
+    {
+        fn(begin, end, ctx);
+        return;
+    }
+
+    RangeTask *tasks = (RangeTask *)malloc(chunk_count * sizeof(RangeTask));
+    if (!tasks)
+    {
+        fn(begin, end, ctx);
+        return;
+    }
+
+    RangeGroup group;
+    pthread_mutex_init(&group.lock, NULL);
+    pthread_cond_init(&group.done, NULL);
+    group.remaining = chunk_count;
+
+    for (int i = 0; i < chunk_count; i++)
+    {
+        tasks[i].fn = fn;
+        tasks[i].ctx = ctx;
+        tasks[i].begin = begin + i * grain;
+        tasks[i].end = tasks[i].begin + grain < end ? tasks[i].begin + grain : end;
+        tasks[i].group = &group;
+        if (thread_pool_submit(pool, run_range_task, &tasks[i]) != 0)
+            run_range_task(&tasks[i]);
+    }
+
+    pthread_mutex_lock(&group.lock);
+    while (group.remaining > 0)
+        pthread_cond_wait(&group.done, &group.lock);
+    pthread_mutex_unlock(&group.lock);
+
+    pthread_mutex_destroy(&group.lock);
+    pthread_cond_destroy(&group.done);
+    free(tasks);
+}
@@ -0,0 +1,22 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+typedef void (*TaskFunc)(void *arg);
+// Processes the half-open index range [begin, end).
+typedef void (*RangeFunc)(int begin, int end, void *ctx);
+
+typedef struct ThreadPool ThreadPool;
+
+// Each worker owns a task deque: it pops its own work LIFO and, when empty,
+// steals FIFO from the other workers.
+ThreadPool *thread_pool_create(int thread_count);
+void thread_pool_destroy(ThreadPool *pool);
+int thread_pool_size(ThreadPool *pool);
+int thread_pool_submit(ThreadPool *pool, TaskFunc fn, void *arg);
+// Blocks until every submitted task has finished.
+void thread_pool_wait(ThreadPool *pool);
+// Splits [begin, end) into chunks of `grain` indices and runs them on the pool,
+// returning once all chunks are done. A NULL pool runs fn inline.
+void thread_pool_parallel_for(ThreadPool *pool, int begin, int end, int grain, RangeFunc fn, void *ctx);
+
+#endif // THREAD_POOL_H